@@ -16,118 +16,442 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
-#include <SDL.h>
+#include "divergence_core.h"
+#include "engine.h"
 
 #include <cstdlib>
+#include <algorithm>
 #include <vector>
 #include <string>
-#include <fstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
 
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 
-const int LEFT = SDL_SCANCODE_LEFT;
-const int UP = SDL_SCANCODE_UP;
-const int RIGHT = SDL_SCANCODE_RIGHT;
-const int DOWN = SDL_SCANCODE_DOWN;
 const int KEY_R = SDL_SCANCODE_R;
+const int KEY_H = SDL_SCANCODE_H;
+const int KEY_Z = SDL_SCANCODE_Z;
+const int KEY_Y = SDL_SCANCODE_Y;
 
-const int FLOOR = 1;
-const int WALL = 2;
+// Levels too large to fit the window at this many pixels per cell scroll
+// to follow the player, keeping at least SCROLL_MARGIN cells between the
+// player and the edge of the window.
+const int MIN_CELL_SIZE = 16;
+const int SCROLL_MARGIN = 3;
 
-struct Point
-{
-    int x, y;
-};
+// How long each move of a replay shown at normal speed takes, in ms.
+const int REPLAY_DELAY = 100;
 
-struct Cell
-{
-    int type;
-    bool isGoal, hasBox;
-};
+// How long each move of a walk, a push or a hint takes, in ms.
+const int MOVE_DELAY = 30;
 
-struct Level
-{
-    int width, height, goals;
-    Point player;
-    std::vector<std::vector<Cell>> map;
-};
+// How many states a hint search may expand.
+const long long HINT_MAX_NODES = 2000000;
+
+// The arrow keys are played as the directions they point, both as
+// direction values and as indexes into DIRECTIONS.
+static_assert(LEFT == ARROW_LEFT && UP == ARROW_UP && RIGHT == ARROW_RIGHT && DOWN == ARROW_DOWN,
+    "The engine numbers the arrow keys differently from the game.");
+static_assert(DIRECTIONS[ARROW_LEFT] == LEFT && DIRECTIONS[ARROW_UP] == UP
+    && DIRECTIONS[ARROW_RIGHT] == RIGHT && DIRECTIONS[ARROW_DOWN] == DOWN,
+    "DIRECTIONS must list the directions in the order the arrow keys are numbered.");
 
 // Function prototypes.
-bool initLevels();
-bool init();
-Level loadLevel(const std::string&);
-bool update(int, Level&);
-Point move(int, const Point&);
-bool moveBox(int, const Point&, Level&);
+Level loadLevel(int);
+bool update(int, Level&, History&);
+void drawMove(const Level&, int, bool, bool);
+bool undo(Level&, History&);
+bool redo(Level&, History&);
+void startHint(const Level&);
+void hintWorker(Level, int);
+void dropHint();
+void playHint();
+void queueMoves(const std::string&);
+bool playQueued(Level&, History&);
+void cancelMoves();
 void render(const Level&);
+void renderMove(const Level&, int, bool);
+void renderCells(const Level&, const int*, int);
+SDL_Rect cellRect(const Level&, int);
+bool followPlayer(const Level&);
+int cellAt(const Level&, int, int);
+void visibleCells(const Level&, int&, int&, int&, int&);
+bool scrollAxis(int&, int, int, int);
+void drawBackground(const Level&);
+void drawPieces(const Level&);
+int playReplay(const char*, bool, double);
+bool replayAction(char, Level&, History&, bool);
+int benchRender(long long, const char*);
+
+// Moves are drawn by patching the last frame instead of drawing every
+// cell again. The background holds the walls and goals of the current
+// level, and the frame holds everything as last presented. Both stay
+// null if the renderer can't draw to textures.
+SDL_Texture* background = nullptr;
+SDL_Texture* frame = nullptr;
+
+// What the background texture shows: which level load, laid out where,
+// and in which colour. It is only drawn again when one of them changes.
+struct BackgroundState
+{
+    int load, xp, yp, cellSize;
+    bool deadlocked;
+};
 
-SDL_Window* window = nullptr;
-SDL_Renderer* renderer = nullptr;
-
-bool fullscreen = true;
-
-int W_WIDTH = 0;
-int W_HEIGHT = 0;
-
-int cellSize = 0, xp = 0, yp = 0;
-
-std::vector<std::string> levels;
+int levelLoads = 0;
+BackgroundState drawnBackground{-1, 0, 0, 0, false};
+
+// Walls, goals, boxes and boxes on goals, each drawn in one call.
+CellBatch walls{{}, 0xFF, 0xFF, 0xFF};
+CellBatch goals{{}, 0xFF, 0x00, 0x00};
+CellBatch boxes{{}, 0xFF, 0x00, 0x00};
+CellBatch boxesOnGoals{{}, 0x00, 0xFF, 0x00};
+
+int minCellSize = MIN_CELL_SIZE;
+
+// Hints are searched for on their own thread, so the window keeps
+// responding. A search posts a hintEvent, with its number, once it is
+// done, and is cancelled if the level changes before then.
+std::thread hintSearch;
+std::atomic<bool> hintCancel(false);
+SolveResult hintResult;
+Uint32 hintEvent;
+int hintNumber = 0;
+
+// The solution hints are played from, and how much of it has been played.
+std::string hint;
+unsigned int hintPos = 0;
+
+// Moves found for a click, a drag or a hint, played one every MOVE_DELAY
+// ms from the main loop, which posts a moveEvent to itself when the next
+// is due. Events are still handled in between, so Escape or a key press
+// can cut a long walk short.
+std::string queuedMoves;
+unsigned int queuedPos = 0;
+Uint32 moveDue = 0;
+Uint32 moveEvent;
+
+// The cell under the mouse when the left button went down, if any.
+int dragFrom = -1;
 
 int main(int argc, char* args[])
 {
-    // Allow a `-w` flag to launch in windowed mode.
-    // Can be followed by width and height: `-w 800 600`.
-    // Defaults to 800x600.
+    // `--solve N` solves level N (counting from 1) without opening a window,
+    // and `--verify-all` solves every level on `-j N` threads.
+    // Add `--moves` to find move-optimal rather than push-optimal solutions,
+    // which is only practical on small levels, and `--max-nodes N` to
+    // change how many states are tried before giving up (0 for no limit).
+    // `--compile IN OUT` writes the compiled form of a level file. The game
+    // keeps its own cache, `levels.bin`, up to date with `levels`.
+    // `--generate N FILE` writes N new levels on `-j N` threads, each the
+    // best of `--candidates N` rooms of `--room W H` cells with
+    // `--boxes N` boxes, from `--seed S`. `--dedupe IN OUT` copies a level
+    // file, leaving out levels that repeat an earlier one, even when
+    // turned, mirrored or written with more space around them.
+    // `--record FILE` saves what is played as a replay. `--replay FILE`
+    // shows one, `--speed N` times as fast, or with 0 a move every frame,
+    // without waiting between them, and with
+    // `--headless` only checks it, without opening a window.
+    // `--timing FILE` saves how long each part of a frame took, as a
+    // CSV file, or JSON if FILE ends in ".json". `--overlay` starts with
+    // the timings drawn over the game, and F3 turns that on and off.
+    // `--bench-render N` plays N moves of a fixed random walk through the
+    // levels, drawn into memory with the software renderer, and reports
+    // how fast they were drawn. `--frame-sums FILE` saves a checksum of
+    // each frame.
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* timingPath = nullptr;
+    const char* sumsPath = nullptr;
+    long long benchFrames = 0;
+    double speed = 1;
+    bool headless = false;
+    int solveLevel = 0;
+    bool solveOne = false;
+    bool verify = false;
+    const char* compileFrom = nullptr;
+    const char* compileTo = nullptr;
+    const char* dedupeFrom = nullptr;
+    const char* dedupeTo = nullptr;
+    int generateCount = 0;
+    const char* generateTo = nullptr;
+    GenerateOptions generateOptions{9, 9, 3, 32, 1};
+    int threads = std::thread::hardware_concurrency();
+    SolveOptions options{false, SOLVE_MAX_NODES, 22, nullptr};
+
+    // `--cell-size N` sets the smallest cell size before levels scroll.
     for(int i = 0; i < argc; i++)
     {
-        if(strcmp(args[i], "-w") == 0)
+        if(strcmp(args[i], "--cell-size") == 0 && i + 1 < argc)
         {
-            fullscreen = false;
-            if(i + 2 < argc)
-            {
-                W_WIDTH = atoi(args[i + 1]);
-                W_HEIGHT = atoi(args[i + 2]);
-            }
-            else
-            {
-                W_WIDTH = 800;
-                W_HEIGHT = 600;
-            }
+            minCellSize = std::max(1, atoi(args[i + 1]));
+        }
+        else if(strcmp(args[i], "--solve") == 0 && i + 1 < argc)
+        {
+            solveLevel = atoi(args[i + 1]);
+            solveOne = true;
+        }
+        else if(strcmp(args[i], "--verify-all") == 0)
+        {
+            verify = true;
+        }
+        else if(strcmp(args[i], "--compile") == 0 && i + 2 < argc)
+        {
+            compileFrom = args[i + 1];
+            compileTo = args[i + 2];
+        }
+        else if(strcmp(args[i], "--dedupe") == 0 && i + 2 < argc)
+        {
+            dedupeFrom = args[i + 1];
+            dedupeTo = args[i + 2];
+        }
+        else if(strcmp(args[i], "--generate") == 0 && i + 2 < argc)
+        {
+            generateCount = atoi(args[i + 1]);
+            generateTo = args[i + 2];
+        }
+        else if(strcmp(args[i], "--room") == 0 && i + 2 < argc)
+        {
+            generateOptions.width = atoi(args[i + 1]);
+            generateOptions.height = atoi(args[i + 2]);
+        }
+        else if(strcmp(args[i], "--boxes") == 0 && i + 1 < argc)
+        {
+            generateOptions.boxes = atoi(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--candidates") == 0 && i + 1 < argc)
+        {
+            generateOptions.candidates = atoi(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--seed") == 0 && i + 1 < argc)
+        {
+            generateOptions.seed = strtoull(args[i + 1], nullptr, 10);
+        }
+        else if(strcmp(args[i], "-j") == 0 && i + 1 < argc)
+        {
+            threads = atoi(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--moves") == 0)
+        {
+            options.optimizeMoves = true;
+        }
+        else if(strcmp(args[i], "--max-nodes") == 0 && i + 1 < argc)
+        {
+            options.maxNodes = atoll(args[i + 1]);
         }
+        else if(strcmp(args[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = args[i + 1];
+        }
+        else if(strcmp(args[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replayPath = args[i + 1];
+        }
+        else if(strcmp(args[i], "--speed") == 0 && i + 1 < argc)
+        {
+            speed = atof(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--headless") == 0)
+        {
+            headless = true;
+        }
+        else if(strcmp(args[i], "--timing") == 0 && i + 1 < argc)
+        {
+            timingPath = args[i + 1];
+        }
+        else if(strcmp(args[i], "--overlay") == 0)
+        {
+            timing.overlay = true;
+        }
+        else if(strcmp(args[i], "--bench-render") == 0 && i + 1 < argc)
+        {
+            benchFrames = atoll(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--frame-sums") == 0 && i + 1 < argc)
+        {
+            sumsPath = args[i + 1];
+        }
+    }
+
+    // Allow a `-w` flag to launch in windowed mode.
+    readWindowArgs(argc, args);
+
+    if(speed < 0)
+    {
+        printf("The replay speed can't be negative.\n");
+        return 1;
     }
 
+    if(compileFrom)
+    {
+        LevelPack pack{nullptr, 0, {}, nullptr, 0, 0, 0};
+        if(!indexLevels(compileFrom, pack) || !checkLevels(pack, compileFrom) || !compileLevels(pack, compileTo)) return 1;
+
+        printf("Compiled %d levels from '%s' into '%s'.\n", pack.count, compileFrom, compileTo);
+        return 0;
+    }
+
+    if(dedupeFrom) return dedupeLevels(dedupeFrom, dedupeTo);
+
+    if(generateTo) return generateLevels(generateCount, generateTo, threads, generateOptions);
+
     if(!initLevels()) return 1;
 
-    if(!init()) return 1;
+    if(solveOne) return solveFromCommandLine(solveLevel, options);
 
-    if(fullscreen)
+    if(verify) return verifyAll(threads, options);
+
+    if(replayPath && headless) return playReplay(replayPath, false, 0);
+
+    if(benchFrames > 0) return benchRender(benchFrames, sumsPath);
+
+    if(!initWindow("Divergence")) return 1;
+
+    if(replayPath)
     {
-        // Set the W_WIDTH and W_HEIGHT variables.
-        SDL_GL_GetDrawableSize(window, &W_WIDTH, &W_HEIGHT);
+        int result = playReplay(replayPath, true, speed);
+
+        if(background) SDL_DestroyTexture(background);
+        if(frame) SDL_DestroyTexture(frame);
+        closeWindow();
+        return result;
+    }
+
+    if(recordPath && !startRecording(recordPath))
+    {
+        closeWindow();
+        return 1;
     }
 
     // Load first level.
     int curLevel = 0;
-    Level level = loadLevel(levels[curLevel]);
+    Level level = loadLevel(curLevel);
+    recordLevel(curLevel);
+
+    History history;
+    startHistory(history, level);
 
     // Render initial state.
     render(level);
 
+    hintEvent = SDL_RegisterEvents(2);
+    moveEvent = hintEvent + 1;
+
     // Main game loop.
     bool running = true;
     while(running)
     {
-        // Handle events.
+        // Handle events. Nothing changes between them, so sleep until the
+        // next one, or until the next queued move is due, then handle any
+        // others that queued up.
         SDL_Event event;
-        while(SDL_PollEvent(&event))
+        if(queuedPos < queuedMoves.size())
         {
+            int wait = (int)(moveDue - SDL_GetTicks());
+            if(wait <= 0 || !SDL_WaitEventTimeout(&event, wait))
+            {
+                memset(&event, 0, sizeof(event));
+                event.type = moveEvent;
+            }
+        }
+        else if(!SDL_WaitEvent(&event))
+        {
+            printf("Could not wait for events! SDL_Error: %s\n", SDL_GetError());
+            break;
+        }
+
+        do
+        {
+            bool completed = false;
+
+            // The next queued move is due.
+            if(event.type == moveEvent && queuedPos < queuedMoves.size())
+            {
+                completed = playQueued(level, history);
+            }
+
+            // A hint search finished, unless it was cancelled since.
+            if(event.type == hintEvent && event.user.code == hintNumber && hintSearch.joinable())
+            {
+                hintSearch.join();
+                if(hintResult.solved)
+                {
+                    hint = hintResult.moves;
+                    hintPos = 0;
+                    playHint();
+                }
+                else if(hintResult.gaveUp)
+                {
+                    printf("No hint: the search gave up after %lld states, so this position may still be solvable.\n",
+                        hintResult.nodes);
+                }
+                else
+                {
+                    printf("No solution found from this position.\n");
+                }
+            }
+
             switch(event.type)
             {
                 case SDL_QUIT:
                     running = false;
                     break;
 
+                case SDL_WINDOWEVENT:
+                    // Parts of the window were uncovered, show them again.
+                    if(event.window.event == SDL_WINDOWEVENT_EXPOSED) render(level);
+                    break;
+
+                case SDL_RENDER_TARGETS_RESET:
+                    // The textures lost their contents, draw them again.
+                    drawnBackground.load = -1;
+                    render(level);
+                    break;
+
+                case SDL_MOUSEBUTTONDOWN:
+                    // Remember where a click or drag started.
+                    if(event.button.button == SDL_BUTTON_LEFT)
+                    {
+                        dragFrom = cellAt(level, event.button.x, event.button.y);
+                    }
+                    break;
+
+                case SDL_MOUSEBUTTONUP:
+                {
+                    if(event.button.button != SDL_BUTTON_LEFT || dragFrom < 0) break;
+
+                    // Clicking a floor cell walks the player there, and
+                    // dragging a box to a cell pushes it there.
+                    int dragTo = cellAt(level, event.button.x, event.button.y);
+                    std::string path;
+                    bool found = false;
+
+                    if(dragTo < 0 || (level.map[dragTo] & WALL))
+                    {
+                        found = false;
+                    }
+                    else if(level.map[dragFrom] & BOX)
+                    {
+                        found = dragTo != dragFrom && findPushPath(level, dragFrom, dragTo, path);
+                    }
+                    else if(dragTo == dragFrom && !(level.map[dragTo] & BOX))
+                    {
+                        found = findWalk(level, level.player, dragTo, path);
+                    }
+
+                    if(found)
+                    {
+                        cancelMoves();
+                        queueMoves(path);
+                    }
+
+                    dragFrom = -1;
+                    break;
+                }
+
                 case SDL_KEYDOWN:
 
                     switch((int) event.key.keysym.scancode)
@@ -136,318 +460,689 @@ int main(int argc, char* args[])
                             running = false;
                             break;
 
-                        case LEFT:
-                        case UP:
-                        case RIGHT:
-                        case DOWN:
+                        case SDL_SCANCODE_LEFT:
+                        case SDL_SCANCODE_UP:
+                        case SDL_SCANCODE_RIGHT:
+                        case SDL_SCANCODE_DOWN:
                             // Move the player, if possible.
-                            // If level is complete, load the next one.
-                            if(update(event.key.keysym.scancode, level))
+                            cancelMoves();
+                            completed = update(arrowDirection(event.key.keysym.scancode), level, history);
+                            break;
+
+                        case KEY_Z:
+                            // Take back the last move.
+                            cancelMoves();
+                            undo(level, history);
+                            break;
+
+                        case KEY_Y:
+                            // Play the last move taken back again.
+                            cancelMoves();
+                            completed = redo(level, history);
+                            break;
+
+                        case KEY_H:
+                            // Play the next step of the hint, or start looking for one.
+                            if(hintPos < hint.size())
                             {
-                                // Wait a bit, for esoteric reasons.
-                                SDL_Delay(800);
-
-                                if(++curLevel < levels.size())
-                                {
-                                    level = loadLevel(levels[curLevel]);
-                                    render(level);
-                                }
-                                else
-                                {
-                                    printf("All levels completed.\n");
-                                    running = false;
-                                }
+                                playHint();
+                            }
+                            else if(!hintSearch.joinable())
+                            {
+                                startHint(level);
                             }
                             break;
 
                         case KEY_R:
-                            // Restart the current level.
-                            level = loadLevel(levels[curLevel]);
+                            // Restart the current level. The moves
+                            // made so far can still be redone.
+                            cancelMoves();
+                            seek(level, history, 0);
+                            recordAction('*');
+                            render(level);
+                            break;
+
+                        case SDL_SCANCODE_F3:
+                            timing.overlay = !timing.overlay;
                             render(level);
                     }
+                    break;
             }
-        }
+
+            // If level is complete, load the next one.
+            if(completed)
+            {
+                // Wait a bit, for esoteric reasons.
+                SDL_Delay(800);
+
+                dropHint();
+                recordEnd(level);
+                if(++curLevel < levels.count)
+                {
+                    level = loadLevel(curLevel);
+                    recordLevel(curLevel);
+                    startHistory(history, level);
+                    render(level);
+                }
+                else
+                {
+                    printf("All levels completed.\n");
+                    running = false;
+                }
+            }
+        } while(running && pollEvent(&event));
+    }
+
+    if(recording.file)
+    {
+        // Close the level being played, unless it was just completed.
+        if(curLevel < levels.count) recordEnd(level);
+        fclose(recording.file);
+    }
+
+    if(timingPath)
+    {
+        printTiming();
+        dumpTiming(timingPath);
     }
 
-    // Destroy the renderer, window, and quit SDL.
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    dropHint();
+
+    // Destroy the textures, renderer, window, and quit SDL.
+    if(background) SDL_DestroyTexture(background);
+    if(frame) SDL_DestroyTexture(frame);
+    closeWindow();
 
     return 0;
 }
 
-bool initLevels()
+Level loadLevel(int number)
 {
-    // Load definition strings of Divergence
-    // levels from the level file.
-    std::ifstream levelFile;
+    // Parse a level and lay it out for drawing.
+    Level level = readLevel(levels, number);
+    levelLoads++;
+
+    // Nothing started on the last level carries over.
+    queuedMoves.clear();
+    queuedPos = 0;
+    dragFrom = -1;
 
-    levelFile.open("levels");
-    if(!levelFile.is_open())
+    // Scale the level to the window, down to the minimum cell size.
+    // Along axes where the level doesn't fit, render() scrolls it
+    // to show the player instead.
+    layoutGrid(level.width, level.height, minCellSize);
+
+    return level;
+}
+
+bool update(int direction, Level &level, History &history)
+{
+    // Move the player, if possible, and draw the move.
+    Uint64 start = startTiming();
+    int entry = play(direction, level, history);
+    endTiming(PHASE_UPDATE, start);
+    if(entry < 0) return false;
+
+    drawMove(level, entry, false, entry & WAS_DEADLOCKED);
+
+    // Check if the level has been completed.
+    return level.goals == 0;
+}
+
+void drawMove(const Level &level, int entry, bool undone, bool wasDeadlocked)
+{
+    // The whole level is redrawn only when it became (or stopped being)
+    // deadlocked, or when it scrolled to follow the player.
+    if(wasDeadlocked != level.deadlocked || followPlayer(level))
     {
-        printf("Error: could not open 'levels'!");
+        render(level);
     }
     else
     {
-        std::string line;
-        std::string level = "";
-        while(std::getline(levelFile, line))
-        {
-            if(line.compare(",") == 0)
-            {
-                level.pop_back();
-                levels.push_back(level);
-                level = "";
-            }
-            else
-            {
-                level += line + "|";
-            }
-        }
+        renderMove(level, entry, undone);
+    }
+}
 
-        levelFile.close();
+bool undo(Level &level, History &history)
+{
+    bool wasDeadlocked = level.deadlocked;
+    Uint64 start = startTiming();
+    int entry = takeBack(level, history);
+    endTiming(PHASE_UPDATE, start);
+    if(entry < 0) return false;
+
+    drawMove(level, entry, true, wasDeadlocked);
+    return true;
+}
 
-        return true;
-    }
+bool redo(Level &level, History &history)
+{
+    // Returns true if redoing the move completes the level.
+    Uint64 start = startTiming();
+    int entry = playAgain(level, history);
+    endTiming(PHASE_UPDATE, start);
+    if(entry < 0) return false;
+
+    drawMove(level, entry, false, entry & WAS_DEADLOCKED);
+    return level.goals == 0;
+}
 
-    return false;
+void startHint(const Level &level)
+{
+    // Look for a solution from the current position on another thread.
+    hintCancel = false;
+    hintNumber++;
+    hintSearch = std::thread(hintWorker, level, hintNumber);
 }
 
-bool init()
+void hintWorker(Level level, int number)
 {
-    // Initialize SDL.
-    if(SDL_Init(SDL_INIT_VIDEO) < 0)
+    hintResult = solve(level, SolveOptions{false, HINT_MAX_NODES, 20, &hintCancel});
+
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = hintEvent;
+    event.user.code = number;
+    SDL_PushEvent(&event);
+}
+
+void dropHint()
+{
+    // Forget the hint, cancelling the search for one if it is still going.
+    if(hintSearch.joinable())
     {
-        printf("SDL could not initialise! SDL_Error: %s\n", SDL_GetError());
+        hintCancel = true;
+        hintSearch.join();
     }
-    else
+
+    hint.clear();
+    hintPos = 0;
+}
+
+void playHint()
+{
+    // Queue the hint up to and including its next push.
+    unsigned int next = hintPos;
+    while(next < hint.size() && !isupper(hint[next])) next++;
+
+    next = std::min(next + 1, (unsigned int) hint.size());
+    queueMoves(hint.substr(hintPos, next - hintPos));
+    hintPos = next;
+}
+
+void queueMoves(const std::string &moves)
+{
+    // Add LURD moves to those still to be played.
+    if(queuedPos >= queuedMoves.size()) moveDue = SDL_GetTicks();
+
+    queuedMoves.erase(0, queuedPos);
+    queuedPos = 0;
+    queuedMoves += moves;
+}
+
+bool playQueued(Level &level, History &history)
+{
+    // Play the next queued move through update(). Returns true if it
+    // completes the level.
+    int d = strchr(DIRECTION_CHARS, tolower(queuedMoves[queuedPos++])) - DIRECTION_CHARS;
+    moveDue = SDL_GetTicks() + MOVE_DELAY;
+
+    return update(DIRECTIONS[d], level, history);
+}
+
+void cancelMoves()
+{
+    // The player took over: stop playing queued moves, and forget the hint.
+    queuedMoves.clear();
+    queuedPos = 0;
+    dropHint();
+}
+
+void render(const Level &level)
+{
+    // Draw the whole level, or the part of it the window shows.
+    Uint64 start = startTiming();
+    followPlayer(level);
+
+    if(!background && SDL_RenderTargetSupported(renderer))
     {
-        // Create window.
-        int flags = SDL_WINDOW_SHOWN;
-        if(fullscreen)
+        background = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, W_WIDTH, W_HEIGHT);
+        frame = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, W_WIDTH, W_HEIGHT);
+        if(!background || !frame)
         {
-            flags |= SDL_WINDOW_FULLSCREEN;
+            if(background) SDL_DestroyTexture(background);
+            if(frame) SDL_DestroyTexture(frame);
+            background = frame = nullptr;
         }
+    }
 
-        window = SDL_CreateWindow("Slither", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, W_WIDTH, W_HEIGHT, flags);
-        if(window == NULL)
-        {
-            printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+    if(!frame)
+    {
+        drawBackground(level);
+        drawPieces(level);
+        endTiming(PHASE_RENDER, start);
+        present();
+        return;
+    }
+
+    BackgroundState state{levelLoads, xp, yp, cellSize, level.deadlocked};
+    if(state.load != drawnBackground.load || state.xp != drawnBackground.xp || state.yp != drawnBackground.yp
+        || state.cellSize != drawnBackground.cellSize || state.deadlocked != drawnBackground.deadlocked)
+    {
+        SDL_SetRenderTarget(renderer, background);
+        drawBackground(level);
+        drawnBackground = state;
+    }
+
+    SDL_SetRenderTarget(renderer, frame);
+    copyTexture(background, nullptr, nullptr);
+    drawPieces(level);
+
+    // Update the window with the rendering performed.
+    SDL_SetRenderTarget(renderer, nullptr);
+    copyTexture(frame, nullptr, nullptr);
+    endTiming(PHASE_RENDER, start);
+    present();
+}
 
-            SDL_Quit();
+void renderMove(const Level &level, int entry, bool undone)
+{
+    // Draw the cells a move changed: where the player was, where the
+    // player is, and where a pushed box ended up (or came back from).
+    int step = move(DIRECTIONS[entry & 3], 0, level);
+    int first = undone ? level.player : level.player - step;
+    int cells[3] = {first, first + step, first + step * 2};
+
+    renderCells(level, cells, (entry & PUSHED) ? 3 : 2);
+}
+
+void renderCells(const Level &level, const int* cells, int count)
+{
+    // Patch the given cells into the last frame, then show it.
+    if(!frame)
+    {
+        render(level);
+        return;
+    }
+
+    Uint64 start = startTiming();
+    SDL_SetRenderTarget(renderer, frame);
+
+    for(int i = 0; i < count; i++)
+    {
+        // Copy the whole slot, including the gap around the cell.
+        SDL_Rect slot = cellRect(level, cells[i]);
+        slot.w++;
+        slot.h++;
+        copyTexture(background, &slot, &slot);
+
+        SDL_Rect r = cellRect(level, cells[i]);
+        if(cells[i] == level.player)
+        {
+            SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0xFF, 0xFF);
+            fillRect(&r);
         }
-        else
+        else if(level.map[cells[i]] & BOX)
         {
-            // Set the renderer, which will be used as
-            // the base for all drawing operations.
-            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-            if(renderer == NULL)
+            if(level.map[cells[i]] & GOAL)
             {
-                printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
-
-                SDL_DestroyWindow(window);
-                SDL_Quit();
+                SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0x00, 0xFF);
             }
             else
             {
-                return true;
+                SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, 0xFF);
             }
+            fillRect(&r);
         }
     }
 
-    return false;
+    SDL_SetRenderTarget(renderer, nullptr);
+    copyTexture(frame, nullptr, nullptr);
+    endTiming(PHASE_RENDER, start);
+    present();
 }
 
-Level loadLevel(const std::string &def)
+SDL_Rect cellRect(const Level &level, int cell)
 {
-    // Create a Divergence level from a definition string.
-    Level level;
-    level.goals = 0;
-    level.map.push_back(std::vector<Cell>());
+    // Where a cell is drawn in the window.
+    return gridCell(cell % level.stride - 1, cell / level.stride - 1);
+}
 
-    int width = 0, height = 0, x = 0;
-    for(unsigned int i = 0; i < def.length(); i++)
-    {
-        switch(def.at(i))
-        {
-            case '.': // Goal.
-                level.map[height].push_back(Cell{FLOOR, true, false, false});
-                level.goals++;
-                break;
+bool followPlayer(const Level &level)
+{
+    // Scroll the level if the player came too close to the edge of
+    // the window. Returns true if it scrolled.
+    int px = level.player % level.stride - 1, py = level.player / level.stride - 1;
 
-            case '$': // Box.
-                level.map[height].push_back(Cell{FLOOR, false, true, false});
-                break;
+    bool scrolledX = scrollAxis(xp, W_WIDTH, level.width, px);
+    bool scrolledY = scrollAxis(yp, W_HEIGHT, level.height, py);
 
-            case '*': // Box over goal.
-                level.map[height].push_back(Cell{FLOOR, true, true, true});
-                break;
+    return scrolledX || scrolledY;
+}
 
-            case '#': // Wall.
-                level.map[height].push_back(Cell{WALL, false, false, false});
-                break;
+int cellAt(const Level &level, int x, int y)
+{
+    // The cell drawn at a point in the window, or -1 if it is outside the level.
+    if(x < xp || y < yp) return -1;
 
-            case '@': // Player.
-                level.player = Point{x, height};
-                level.map[height].push_back(Cell{FLOOR, false, false, false});
-                break;
+    x = (x - xp) / cellSize;
+    y = (y - yp) / cellSize;
+    if(x >= level.width || y >= level.height) return -1;
 
-            case '&': // Player over goal.
-                level.player = Point{x, height};
-                level.map[height].push_back(Cell{FLOOR, true, false, false});
-                level.goals++;
-                break;
+    return (y + 1) * level.stride + x + 1;
+}
 
-            case '|': // Start a new row.
-                height++;
-                if(x > width) width = x;
+void visibleCells(const Level &level, int &x0, int &y0, int &x1, int &y1)
+{
+    // The range of columns [x0, x1) and rows [y0, y1) inside the window.
+    x0 = std::max(0, -xp / cellSize);
+    y0 = std::max(0, -yp / cellSize);
+    x1 = std::min(level.width, (W_WIDTH - xp + cellSize - 1) / cellSize);
+    y1 = std::min(level.height, (W_HEIGHT - yp + cellSize - 1) / cellSize);
+}
 
-                x = -1;
-                level.map.push_back(std::vector<Cell>());
-                break;
+bool scrollAxis(int &offset, int window, int cells, int player)
+{
+    // Levels that fit along this axis stay centred.
+    int size = cells * cellSize;
+    if(size <= window) return false;
+
+    int margin = std::min(SCROLL_MARGIN, window / cellSize / 4) * cellSize;
+    int pos = player * cellSize + offset;
+    if(pos >= margin && pos + cellSize <= window - margin) return false;
+
+    // Centre on the player, without showing past the edge of the level.
+    // Jumping rather than scrolling by a cell keeps most moves incremental.
+    int target = window / 2 - player * cellSize - cellSize / 2;
+    target = std::max(window - size, std::min(0, target));
+    if(target == offset) return false;
+
+    offset = target;
+    return true;
+}
 
-            default: // Empty floor.
-                level.map[height].push_back(Cell{FLOOR, false, false, false});
-                break;
-        }
+void drawBackground(const Level &level)
+{
+    // Fill the entire surface with black, or dark red
+    // once the level can no longer be completed.
+    if(level.deadlocked)
+    {
+        SDL_SetRenderDrawColor(renderer, 0x40, 0x00, 0x00, 0xFF);
+    }
+    else
+    {
+        SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
+    }
+    clearTarget();
+
+    // Used to draw goals, which need to be comparatively smaller than boxes.
+    int quarter = cellSize / 4;
+
+    // Only visit the cells inside the window.
+    int x0, y0, x1, y1;
+    visibleCells(level, x0, y0, x1, y1);
 
-        x++;
+    for(int y = y0; y < y1; y++)
+    {
+        const uint8_t* row = &level.map[(y + 1) * level.stride + 1];
+        for(int x = x0; x < x1; x++)
+        {
+            if(row[x] & WALL)
+            {
+                walls.rects.push_back(gridCell(x, y));
+            }
+            else if(row[x] & GOAL)
+            {
+                goals.rects.push_back(SDL_Rect{x * cellSize + quarter + xp, y * cellSize + quarter + yp, cellSize - quarter * 2, cellSize - quarter * 2});
+            }
+        }
     }
 
-    level.width = width;
-    level.height = ++height;
+    // Draw the walls, then the goals.
+    drawBatch(walls);
+    drawBatch(goals);
+}
 
-    // Determine cellSize based on level and window dimensions.
-    // Allows the drawn map to scale to the window size.
-    cellSize = (int)std::min(W_WIDTH / width, W_HEIGHT / height);
+void drawPieces(const Level &level)
+{
+    // Draw the boxes over the background. If a box is on a goal,
+    // draw it in green to differentiate it from other boxes.
+    int x0, y0, x1, y1;
+    visibleCells(level, x0, y0, x1, y1);
 
-    // Determine x and y padding, which are
-    // used to centre the level within the window.
-    xp = (int)((W_WIDTH - (cellSize * width)) / 2);
-    yp = (int)((W_HEIGHT - (cellSize * height)) / 2);
+    for(int y = y0; y < y1; y++)
+    {
+        const uint8_t* row = &level.map[(y + 1) * level.stride + 1];
+        for(int x = x0; x < x1; x++)
+        {
+            if(!(row[x] & BOX)) continue;
 
-    return level;
+            if(row[x] & GOAL)
+            {
+                boxesOnGoals.rects.push_back(gridCell(x, y));
+            }
+            else
+            {
+                boxes.rects.push_back(gridCell(x, y));
+            }
+        }
+    }
+
+    drawBatch(boxes);
+    drawBatch(boxesOnGoals);
+
+    // Draw the player.
+    SDL_Rect r = cellRect(level, level.player);
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0xFF, 0xFF);
+    fillRect(&r);
 }
 
-bool update(int direction, Level &level)
+int playReplay(const char* path, bool show, double speed)
 {
-    Point dest = move(direction, level.player);
-    if(level.map[dest.y][dest.x].type != WALL)
+    // Play a recorded session back, checking each level ends the way it
+    // was recorded ending. When shown, each move takes REPLAY_DELAY / speed
+    // ms, and Escape stops it. Returns 0 if every level matched.
+    FILE* file = fopen(path, "r");
+    if(!file)
     {
-        // If the player moves into a box, we try to push that box.
-        if(level.map[dest.y][dest.x].hasBox && moveBox(direction, dest, level))
+        printf("Could not open replay '%s'!\n", path);
+        return 1;
+    }
+
+    char line[REPLAY_COLUMNS + 8];
+    if(!fgets(line, sizeof(line), file) || strncmp(line, REPLAY_MAGIC, strlen(REPLAY_MAGIC)) != 0)
+    {
+        printf("'%s' is not a Divergence replay!\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    int delay = speed > 0 ? (int)(REPLAY_DELAY / speed) : 0;
+
+    Level level;
+    History history;
+    int number = 0, levelsPlayed = 0, failures = 0, step = 0;
+    long long actions = 0;
+    bool playing = false, stopped = false;
+
+    auto start = std::chrono::steady_clock::now();
+    while(!stopped && fgets(line, sizeof(line), file))
+    {
+        if(strncmp(line, "level ", 6) == 0)
         {
-            level.player = dest;
+            number = atoi(line + 6);
+            playing = number >= 1 && number <= levels.count;
+            if(!playing)
+            {
+                printf("The replay plays level %d, which doesn't exist!\n", number);
+                failures++;
+                continue;
+            }
 
-            render(level);
+            level = show ? loadLevel(number - 1) : readLevel(levels, number - 1);
+            startHistory(history, level);
+            if(show) render(level);
+            levelsPlayed++;
+            step = 0;
+        }
+        else if(strncmp(line, "end ", 4) == 0)
+        {
+            if(!playing) continue;
+            playing = false;
 
-            // Check if the level has been completed.
-            if(level.goals == 0)
+            unsigned long long hash = strtoull(line + 4, nullptr, 16);
+            if(hash != hashLevel(level))
+            {
+                printf("Level %d does not match the replay!\n", number);
+                failures++;
+            }
+            else
             {
-                return true;
+                printf("Level %d matches the replay%s.\n", number, level.goals == 0 ? ", completed" : "");
             }
         }
-        else if(!level.map[dest.y][dest.x].hasBox)
+        else if(playing)
         {
-            level.player = dest;
+            for(char* c = line; *c && *c != '\n' && !stopped; c++)
+            {
+                actions++;
+                step++;
+                if(!replayAction(*c, level, history, show))
+                {
+                    printf("Level %d: action %d, '%c', can't be played!\n", number, step, *c);
+                    failures++;
+                    playing = false;
+                    break;
+                }
+
+                if(!show) continue;
 
-            render(level);
+                SDL_Delay(delay);
+
+                // Keep the window responsive, and let Escape stop the replay.
+                SDL_Event event;
+                while(pollEvent(&event))
+                {
+                    if(event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE))
+                    {
+                        stopped = true;
+                    }
+                    else if(event.type == SDL_RENDER_TARGETS_RESET ||
+                        (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED))
+                    {
+                        if(event.type == SDL_RENDER_TARGETS_RESET) drawnBackground.load = -1;
+                        render(level);
+                    }
+                }
+            }
         }
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    return false;
-}
+    fclose(file);
 
-Point move(int direction, const Point &src)
-{
-    switch(direction)
+    if(playing && !stopped)
     {
-        case LEFT: return Point{src.x - 1, src.y};
-        case UP: return Point{src.x, src.y - 1};
-        case RIGHT: return Point{src.x + 1, src.y};
-        case DOWN: return Point{src.x, src.y + 1};
+        printf("Level %d has no end line in the replay!\n", number);
+        failures++;
     }
+
+    printf("Replayed %lld actions over %d levels in %.3fs, %d problems.\n", actions, levelsPlayed, seconds, failures);
+    return failures == 0 && !stopped ? 0 : 1;
 }
 
-bool moveBox(int direction, const Point &src, Level &level)
+bool replayAction(char action, Level &level, History &history, bool show)
 {
-    // We move the box if the destination does not
-    // contain a wall or another box.
-    Point dest = move(direction, src);
-    if(level.map[dest.y][dest.x].type != WALL && !level.map[dest.y][dest.x].hasBox)
-    {
-        level.map[src.y][src.x].hasBox = false;
-        level.map[dest.y][dest.x].hasBox = true;
-
-        // Increment remaining goals if the box was pushed off a goal.
-        if(level.map[src.y][src.x].isGoal) level.goals++;
-
-        // Decrement remaining goals if the box was pushed onto a goal.
-        if(level.map[dest.y][dest.x].isGoal) level.goals--;
+    // Play one action of a replay, and draw it when shown.
+    bool wasDeadlocked = level.deadlocked;
+    int entry = playAction(action, level, history);
+    if(entry < 0) return false;
 
-        return true;
+    if(show && entry == RESTARTED)
+    {
+        render(level);
+    }
+    else if(show)
+    {
+        drawMove(level, entry, action == '-', wasDeadlocked);
     }
 
-    return false;
+    return true;
 }
 
-void render(const Level &level)
+int benchRender(long long frames, const char* sumsPath)
 {
-    // Fill the entire surface with black.
-    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
-    SDL_RenderClear(renderer);
+    // Walk through the levels as the core benchmark does, with benchMove,
+    // drawing into memory. A frame is a level being drawn whole
+    // or a move being drawn. The walk is the same every time, and only
+    // drawing is timed.
+    if(!initOffscreen()) return 1;
+
+    FILE* sums = nullptr;
+    if(sumsPath && (sums = fopen(sumsPath, "w")) == NULL)
+    {
+        printf("Couldn't open %s for writing.\n", sumsPath);
+    }
+    else
+    {
+        Level level;
+        History history;
+        uint64_t rng = 1;
 
-    // Used to draw goals, which need to be comparatively smaller than boxes.
-    int quarter = cellSize / 4;
+        // All the frame checksums, hashed together.
+        uint64_t all = FNV_OFFSET;
 
-    for(unsigned int y = 0; y < level.height; y++)
-    {
-        for(unsigned int x = 0; x < level.map[y].size(); x++)
+        Uint64 spent = 0;
+        drawCalls = 0;
+        for(long long f = 0; f < frames; f++)
         {
-            if(level.map[y][x].type == FLOOR)
+            Uint64 start;
+            if(f % BENCH_LEVEL_MOVES == 0)
             {
-                if(level.map[y][x].hasBox)
-                {
-                    // Determine what colour the box should be.
-                    // If the box is on a goal, draw it in green
-                    // to differentiate it from other boxes.
-                    if(level.map[y][x].isGoal)
-                    {
-                        SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0x00, 0xFF);
-                    }
-                    else
-                    {
-                        SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, 0xFF);
-                    }
+                level = loadLevel(f / BENCH_LEVEL_MOVES % levels.count);
+                startHistory(history, level);
 
-                    // Draw the boxes.
-                    SDL_Rect r{x * cellSize + xp, y * cellSize + yp, cellSize - 1, cellSize - 1};
-                    SDL_RenderFillRect(renderer, &r);
+                start = SDL_GetPerformanceCounter();
+                render(level);
+            }
+            else
+            {
+                bool wasDeadlocked = level.deadlocked;
+                bool undone;
+                int entry = benchMove(level, history, rng, undone);
+
+                start = SDL_GetPerformanceCounter();
+                if(entry >= 0)
+                {
+                    drawMove(level, entry, undone, wasDeadlocked);
                 }
-                else if(level.map[y][x].isGoal)
+                else
                 {
-                    // Draw the goals.
-                    SDL_Rect r{x * cellSize + quarter + xp, y * cellSize + quarter + yp, cellSize - quarter * 2, cellSize - quarter * 2};
-                    SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, 0xFF);
-                    SDL_RenderFillRect(renderer, &r);
+                    render(level);
                 }
             }
-            else
+            spent += SDL_GetPerformanceCounter() - start;
+
+            if(sums)
             {
-                // Draw the walls.
-                SDL_Rect r{x * cellSize + xp, y * cellSize + yp, cellSize - 1, cellSize - 1};
-                SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-                SDL_RenderFillRect(renderer, &r);
+                uint64_t sum = frameChecksum();
+                fprintf(sums, "%lld %016llx\n", f, (unsigned long long) sum);
+                all = fnvMix(all, sum);
             }
         }
+        double seconds = (double) spent / SDL_GetPerformanceFrequency();
+
+        printf("%lld frames at %dx%d in %.3fs (%.0f frames/s).\n", frames, W_WIDTH, W_HEIGHT, seconds,
+            frames / std::max(seconds, 1e-9));
+        printf("%.1f draw calls a frame.\n", (double) drawCalls / frames);
+        if(sums) printf("Frame checksums saved to %s, all frames %016llx.\n", sumsPath, (unsigned long long) all);
     }
 
-    // Draw the player.
-    SDL_Rect r{level.player.x * cellSize + xp, level.player.y * cellSize + yp, cellSize - 1, cellSize - 1};
-    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0xFF, 0xFF);
-    SDL_RenderFillRect(renderer, &r);
+    if(sums) fclose(sums);
+    if(background) SDL_DestroyTexture(background);
+    if(frame) SDL_DestroyTexture(frame);
+    closeWindow();
 
-    // Update the window with the rendering performed.
-    SDL_RenderPresent(renderer);
+    return sumsPath && !sums ? 1 : 0;
 }
+
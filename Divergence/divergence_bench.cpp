@@ -0,0 +1,115 @@
+/*
+ * Divergence (a Sokoban (or Sokouban if you're a purist) clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "divergence_core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Function prototypes.
+int benchMoves(long long);
+int benchWalks(long long);
+
+int main(int argc, char* args[])
+{
+    // Benchmarks of the Divergence core on the levels file: playing and
+    // taking back moves, finding walks, and solving every level.
+    long long count = argc > 1 ? atoll(args[1]) : 1000000;
+    if(count <= 0)
+    {
+        printf("Usage: divergence_bench [moves]\n");
+        return 1;
+    }
+
+    if(!initLevels()) return 1;
+
+    int result = 0;
+    result |= benchMoves(count);
+    result |= benchWalks(count / 100 + 1);
+    result |= verifyAll(std::max((int) std::thread::hardware_concurrency(), 1), SolveOptions{false, SOLVE_MAX_NODES, 22, nullptr});
+
+    return result;
+}
+
+int benchMoves(long long count)
+{
+    // Play the same random walk through the levels every run, taking one
+    // move in eight back, as the render benchmark does without drawing.
+    Level level;
+    History history;
+    uint64_t rng = 1, hash = 0;
+    long long played = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(long long i = 0; i < count; i++)
+    {
+        if(i % BENCH_LEVEL_MOVES == 0)
+        {
+            level = readLevel(levels, i / BENCH_LEVEL_MOVES % levels.count);
+            startHistory(history, level);
+        }
+
+        bool undone;
+        if(benchMove(level, history, rng, undone) >= 0) played++;
+        hash = hash * 31 + level.player;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%lld moves in %.3fs (%.0f moves/s), %lld played, walk hash %016llx.\n",
+        count, seconds, count / seconds, played, (unsigned long long) hash);
+
+    return 0;
+}
+
+int benchWalks(long long count)
+{
+    // Find walks between random floor cells of each level in turn, the
+    // search behind mouse clicks and the solver's pushes.
+    std::vector<Level> pack;
+    for(int i = 0; i < levels.count; i++) pack.push_back(readLevel(levels, i));
+
+    uint64_t rng = 1;
+    long long found = 0;
+    std::string path;
+    size_t steps = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(long long i = 0; i < count; i++)
+    {
+        const Level &level = pack[i % pack.size()];
+
+        path.clear();
+        int to = splitmix64(rng) % level.map.size();
+        if(findWalk(level, level.player, to, path))
+        {
+            found++;
+            steps += path.size();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%lld walks in %.3fs (%.0f walks/s), %lld found, %zu steps.\n",
+        count, seconds, count / seconds, found, steps);
+
+    return 0;
+}
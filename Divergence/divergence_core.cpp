@@ -0,0 +1,2265 @@
+/*
+ * Divergence (a Sokoban (or Sokouban if you're a purist) clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "divergence_core.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <unordered_set>
+
+#include <string.h>
+#include <ctype.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Layout of a compiled level file: a header, the offset of every level
+// (with one more marking the end of the last), then the levels. Each level
+// is a PackedLevel followed by its wall, goal and box layers, one bit per
+// cell in row order, padded so the next level starts 8-byte aligned.
+const char PACK_MAGIC[4] = {'D', 'V', 'L', 'B'};
+const uint32_t PACK_VERSION = 1;
+
+struct PackHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;  // Hash of the text file this was compiled from.
+    uint32_t count;
+    uint32_t skipped;     // Levels of the text file that were left out.
+};
+
+struct PackedLevel
+{
+    uint16_t width, height, playerX, playerY;
+};
+
+// Levels still to be verified or generated by one worker thread. Idle
+// workers steal from the front of each other's queues.
+struct WorkQueue
+{
+    std::mutex lock;
+    std::deque<int> jobs;
+};
+
+// The best candidate found for a generated level, and how it scored.
+// A score of -1 means no candidate could be solved.
+struct Generated
+{
+    std::string text;
+    int pushes, moves, changes, score;
+};
+
+// Function prototypes.
+bool mapCompiledLevels(const char*, uint64_t, LevelPack&);
+Level unpackLevel(const uint8_t*);
+void takeSnapshot(Snapshot&, const Level&);
+uint64_t fillUp(uint64_t, uint64_t);
+uint64_t fillDown(uint64_t, uint64_t);
+bool isFrozen(Level&, int, bool&);
+void spreadCells(const CellSet&, const CellSet&, CellSet&, int, int);
+bool labelSides(const Level&, CellSet&, CellSet&, int, int8_t*, int&);
+bool isBlocked(Level&, int, int, bool&);
+int takeJob(int, std::vector<WorkQueue>&);
+void verifyWorker(int, std::vector<WorkQueue>&, const SolveOptions&, std::vector<SolveResult>&);
+bool carveRoom(Level&, const GenerateOptions&, uint64_t&);
+void pullBoxes(Level&, int, uint64_t&);
+int countBoxChanges(Level, const std::string&);
+Generated generateLevel(int, const GenerateOptions&, const SolveOptions&);
+void generateWorker(int, std::vector<WorkQueue>&, const GenerateOptions&, const SolveOptions&, std::vector<Generated>&);
+
+LevelPack levels{nullptr, 0, {}, nullptr, 0, 0, 0};
+
+Recording recording{nullptr, 0};
+
+bool initLevels()
+{
+    // Load the levels from the compiled cache if it matches the level
+    // file, otherwise index the level file and rebuild the cache.
+    if(!indexLevels("levels", levels)) return false;
+
+    uint64_t hash = fnvBytes(FNV_OFFSET, levels.data, levels.size);
+    if(mapCompiledLevels("levels.bin", hash, levels))
+    {
+        // The text is no longer needed.
+        munmap((void*) levels.data, levels.size);
+        levels.data = nullptr;
+        levels.size = 0;
+        levels.index = std::vector<LevelSpan>();
+
+        return true;
+    }
+
+    if(!checkLevels(levels, "levels")) return false;
+
+    if(!compileLevels(levels, "levels.bin"))
+    {
+        printf("Warning: could not write 'levels.bin', using 'levels' directly.\n");
+    }
+
+    return true;
+}
+
+bool indexLevels(const char* path, LevelPack &pack)
+{
+    // Map a level file into memory and index the comma lines that
+    // separate levels. Nothing is copied or parsed until a level is used.
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        printf("Error: could not open '%s'!\n", path);
+        return false;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) < 0 || info.st_size == 0)
+    {
+        printf("Error: could not read '%s'!\n", path);
+        close(fd);
+        return false;
+    }
+
+    // The mapping lives for as long as the program does.
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+    {
+        printf("Error: could not map '%s'!\n", path);
+        return false;
+    }
+
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    pack.data = (const char*) data;
+    pack.size = info.st_size;
+    pack.index.clear();
+    pack.skipped = 0;
+
+    const char* text = pack.data;
+    const char* end = text + pack.size;
+    size_t begin = 0;
+    for(const char* c = text; (c = (const char*) memchr(c, ',', end - c)) != nullptr; c++)
+    {
+        // Only a comma on a line of its own ends a level.
+        bool lineStart = c == text || c[-1] == '\n';
+        bool lineEnd = c + 1 == end || c[1] == '\n' || c[1] == '\r';
+        if(!lineStart || !lineEnd) continue;
+
+        pack.index.push_back(LevelSpan{begin, (size_t)(c - text)});
+
+        const char* next = (const char*) memchr(c, '\n', end - c);
+        begin = next ? next + 1 - text : pack.size;
+    }
+
+    madvise(data, info.st_size, MADV_RANDOM);
+
+    pack.count = pack.index.size();
+    if(pack.count == 0)
+    {
+        printf("Error: no levels found in '%s'!\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool checkLevels(LevelPack &pack, const char* path)
+{
+    // Parse every level of a text pack, and leave out the ones that can't
+    // be played, saying which. The levels after one that is left out move
+    // up a number. Returns false if no level is left.
+    std::vector<LevelSpan> index;
+    for(int n = 0; n < pack.count; n++)
+    {
+        const char* error = levelError(readLevel(pack, n));
+        if(error)
+        {
+            printf("Warning: level %d of '%s' %s, so it is left out.\n", n + 1, path, error);
+            continue;
+        }
+
+        index.push_back(pack.index[n]);
+    }
+
+    pack.skipped += pack.count - index.size();
+    pack.index = index;
+    pack.count = index.size();
+    if(pack.count == 0)
+    {
+        printf("Error: no level in '%s' can be played!\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool compileLevels(const LevelPack &pack, const char* path)
+{
+    // Write the levels of a text pack in compiled form. The file is
+    // written under a temporary name first, so a reader never maps
+    // a half written cache.
+    std::vector<uint64_t> offsets(pack.count + 1);
+    std::vector<uint8_t> body;
+
+    size_t start = sizeof(PackHeader) + offsets.size() * sizeof(uint64_t);
+    for(int n = 0; n < pack.count; n++)
+    {
+        offsets[n] = start + body.size();
+
+        Level level = readLevel(pack, n);
+        if(level.width > UINT16_MAX || level.height > UINT16_MAX)
+        {
+            printf("Error: level %d is %dx%d, too large to compile.\n", n + 1, level.width, level.height);
+            return false;
+        }
+        if(const char* error = levelError(level))
+        {
+            printf("Error: level %d %s, so it can't be compiled.\n", n + 1, error);
+            return false;
+        }
+
+        int area = level.width * level.height;
+        int layerBytes = (area + 7) / 8;
+
+        PackedLevel packed{(uint16_t) level.width, (uint16_t) level.height,
+            (uint16_t)(level.player % level.stride - 1), (uint16_t)(level.player / level.stride - 1)};
+
+        size_t at = body.size();
+        size_t size = sizeof(PackedLevel) + layerBytes * 3;
+        body.resize(at + ((size + 7) & ~(size_t) 7), 0);
+        memcpy(&body[at], &packed, sizeof(PackedLevel));
+
+        uint8_t* layers = &body[at + sizeof(PackedLevel)];
+        for(int i = 0; i < area; i++)
+        {
+            uint8_t cell = level.map[(i / level.width + 1) * level.stride + i % level.width + 1];
+            uint8_t bit = 1 << (i % 8);
+
+            if(cell & WALL) layers[i / 8] |= bit;
+            if(cell & GOAL) layers[layerBytes + i / 8] |= bit;
+            if(cell & BOX) layers[layerBytes * 2 + i / 8] |= bit;
+        }
+    }
+    offsets[pack.count] = start + body.size();
+
+    PackHeader header;
+    memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = PACK_VERSION;
+    header.sourceHash = fnvBytes(FNV_OFFSET, pack.data, pack.size);
+    header.count = pack.count;
+    header.skipped = pack.skipped;
+
+    std::string temp = std::string(path) + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if(file == nullptr) return false;
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size()
+        && fwrite(body.data(), 1, body.size(), file) == body.size();
+
+    if(fclose(file) != 0 || !written || rename(temp.c_str(), path) != 0)
+    {
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool mapCompiledLevels(const char* path, uint64_t sourceHash, LevelPack &pack)
+{
+    // Map a compiled level file, if it exists and was
+    // compiled from text with the given hash.
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat info;
+    if(fstat(fd, &info) < 0 || (size_t) info.st_size < sizeof(PackHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return false;
+
+    const PackHeader* header = (const PackHeader*) data;
+    const uint64_t* offsets = (const uint64_t*)(header + 1);
+    bool valid = memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0
+        && header->version == PACK_VERSION
+        && header->sourceHash == sourceHash
+        && header->count > 0
+        && sizeof(PackHeader) + ((size_t) header->count + 1) * sizeof(uint64_t) <= (size_t) info.st_size
+        && offsets[header->count] == (uint64_t) info.st_size;
+
+    // Every level must lie inside the file, and fit all of its layers
+    // before the next one starts.
+    uint64_t start = sizeof(PackHeader) + ((uint64_t) header->count + 1) * sizeof(uint64_t);
+    for(uint32_t n = 0; valid && n < header->count; n++)
+    {
+        valid = offsets[n] >= start && offsets[n] % 8 == 0 && offsets[n] <= offsets[n + 1]
+            && offsets[n + 1] - offsets[n] >= sizeof(PackedLevel);
+        if(!valid) break;
+
+        const PackedLevel* packed = (const PackedLevel*)((const uint8_t*) data + offsets[n]);
+        uint64_t layerBytes = ((uint64_t) packed->width * packed->height + 7) / 8;
+        valid = sizeof(PackedLevel) + layerBytes * 3 <= offsets[n + 1] - offsets[n]
+            && packed->playerX < packed->width && packed->playerY < packed->height;
+    }
+
+    if(!valid)
+    {
+        munmap(data, info.st_size);
+        return false;
+    }
+
+    pack.compiled = (const uint8_t*) data;
+    pack.compiledSize = info.st_size;
+    pack.count = header->count;
+    pack.skipped = header->skipped;
+
+    return true;
+}
+
+Level unpackLevel(const uint8_t* record)
+{
+    // Create a Divergence level from its compiled form.
+    const PackedLevel* packed = (const PackedLevel*) record;
+    const uint8_t* layers = record + sizeof(PackedLevel);
+
+    Level level;
+    level.width = packed->width;
+    level.height = packed->height;
+    level.stride = level.width + 2;
+    level.goals = 0;
+    level.deadlocked = false;
+    level.surplus = 0;
+    level.player = (packed->playerY + 1) * level.stride + packed->playerX + 1;
+    level.map.assign(level.stride * (level.height + 2), WALL);
+
+    int area = level.width * level.height;
+    int layerBytes = (area + 7) / 8;
+    for(int i = 0; i < area; i++)
+    {
+        uint8_t bit = 1 << (i % 8);
+        uint8_t cell = 0;
+
+        if(layers[i / 8] & bit) cell |= WALL;
+        if(layers[layerBytes + i / 8] & bit) cell |= GOAL;
+        if(layers[layerBytes * 2 + i / 8] & bit) cell |= BOX;
+
+        if(cell == GOAL) level.goals++;
+        level.map[(i / level.width + 1) * level.stride + i % level.width + 1] = cell;
+    }
+
+    findDeadSquares(level);
+
+    return level;
+}
+
+Level parseLevel(const char* def, const char* end)
+{
+    // Create a Divergence level from its definition
+    // text, one row of the level per line.
+    Level level;
+    level.goals = 0;
+    level.deadlocked = false;
+    level.surplus = 0;
+    level.player = 0;
+    int players = 0;
+
+    // Ignore the line break ending the last row.
+    while(end > def && (end[-1] == '\n' || end[-1] == '\r')) end--;
+
+    // Measure the level first, so the map can be allocated in one go.
+    int width = 0, height = 1, x = 0;
+    for(const char* c = def; c < end; c++)
+    {
+        if(*c == '\r') continue;
+
+        if(*c == '\n')
+        {
+            height++;
+            x = 0;
+        }
+        else if(++x > width)
+        {
+            width = x;
+        }
+    }
+
+    level.width = width;
+    level.height = height;
+    level.stride = width + 2;
+    level.map.assign(level.stride * (height + 2), 0);
+
+    // Wall off the border. Rows shorter than the
+    // widest one are padded with empty floor.
+    for(int i = 0; i < level.stride; i++)
+    {
+        level.map[i] = WALL;
+        level.map[(height + 1) * level.stride + i] = WALL;
+    }
+    for(int y = 1; y <= height; y++)
+    {
+        level.map[y * level.stride] = WALL;
+        level.map[y * level.stride + width + 1] = WALL;
+    }
+
+    int cell = level.stride + 1, row = cell;
+    for(const char* c = def; c < end; c++)
+    {
+        switch(*c)
+        {
+            case '.': // Goal.
+                level.map[cell] = GOAL;
+                level.goals++;
+                break;
+
+            case '$': // Box.
+                level.map[cell] = BOX;
+                break;
+
+            case '*': // Box over goal.
+                level.map[cell] = BOX | GOAL;
+                break;
+
+            case '#': // Wall.
+                level.map[cell] = WALL;
+                break;
+
+            case '@': // Player.
+                level.player = cell;
+                players++;
+                break;
+
+            case '&': // Player over goal.
+                level.player = cell;
+                players++;
+                level.map[cell] = GOAL;
+                level.goals++;
+                break;
+
+            case '\n': // Start a new row.
+                row += level.stride;
+                cell = row - 1;
+                break;
+
+            case '\r':
+                continue;
+
+            default: // Empty floor.
+                break;
+        }
+
+        cell++;
+    }
+
+    // A level without exactly one player is marked as having none,
+    // which levelError reports.
+    if(players != 1) level.player = 0;
+
+    findDeadSquares(level);
+
+    return level;
+}
+
+Level readLevel(const LevelPack &pack, int number)
+{
+    // Read a level from a level pack, counting from 0.
+    if(pack.compiled)
+    {
+        const uint64_t* offsets = (const uint64_t*)(pack.compiled + sizeof(PackHeader));
+        return unpackLevel(pack.compiled + offsets[number]);
+    }
+
+    const LevelSpan &span = pack.index[number];
+    return parseLevel(pack.data + span.begin, pack.data + span.end);
+}
+
+const char* levelError(const Level &level)
+{
+    // Why a level can't be played, or nullptr if it can.
+    if(level.width == 0) return "is empty";
+    if(level.player == 0) return "doesn't have exactly one player";
+
+    return nullptr;
+}
+
+std::string levelText(const Level &level)
+{
+    // Write a level the way parseLevel reads it. Walls that touch no
+    // floor are left out, along with the rows and columns of outside
+    // space that leaves around the level.
+    std::vector<std::string> rows;
+    for(int y = 1; y <= level.height; y++)
+    {
+        std::string row;
+        for(int x = 1; x <= level.width; x++)
+        {
+            int cell = y * level.stride + x;
+            uint8_t flags = level.map[cell];
+
+            char c = ' ';
+            if(flags & WALL)
+            {
+                for(int dy = -1; dy <= 1 && c == ' '; dy++)
+                {
+                    for(int dx = -1; dx <= 1; dx++)
+                    {
+                        int next = cell + dy * level.stride + dx;
+                        if(next >= 0 && next < (int) level.map.size() && !(level.map[next] & WALL)) c = '#';
+                    }
+                }
+            }
+            else if(cell == level.player)
+            {
+                c = (flags & GOAL) ? '&' : '@';
+            }
+            else if(flags & BOX)
+            {
+                c = (flags & GOAL) ? '*' : '$';
+            }
+            else if(flags & GOAL)
+            {
+                c = '.';
+            }
+
+            row.push_back(c);
+        }
+
+        while(!row.empty() && row.back() == ' ') row.pop_back();
+        rows.push_back(row);
+    }
+
+    while(!rows.empty() && rows.back().empty()) rows.pop_back();
+    while(!rows.empty() && rows.front().empty()) rows.erase(rows.begin());
+
+    size_t indent = std::string::npos;
+    for(unsigned int i = 0; i < rows.size(); i++)
+    {
+        if(!rows[i].empty()) indent = std::min(indent, rows[i].find_first_not_of(' '));
+    }
+
+    std::string text;
+    for(unsigned int i = 0; i < rows.size(); i++)
+    {
+        if(!rows[i].empty()) text.append(rows[i], indent, std::string::npos);
+        text.push_back('\n');
+    }
+
+    return text;
+}
+
+int play(int direction, Level &level, History &history)
+{
+    // Move the player, if possible, and record the move in the history.
+    // Returns the journal entry for the move, or -1 if the player can't move.
+    int entry = applyMove(direction, level);
+    if(entry < 0) return -1;
+
+    // A new move discards any moves that were taken back.
+    if(history.position < history.moves.size())
+    {
+        history.moves.resize(history.position);
+        history.snapshots.resize(history.position / SNAPSHOT_INTERVAL + 1);
+    }
+
+    history.moves.push_back(entry);
+    history.position++;
+
+    if(history.position % SNAPSHOT_INTERVAL == 0)
+    {
+        history.snapshots.push_back(Snapshot());
+        takeSnapshot(history.snapshots.back(), level);
+    }
+
+    recordAction(moveChar(entry));
+    return entry;
+}
+
+int applyMove(int direction, Level &level)
+{
+    // Returns the journal entry for the move, or -1 if the player can't move.
+    int entry = 0;
+    while(DIRECTIONS[entry] != direction) entry++;
+    if(level.deadlocked) entry |= WAS_DEADLOCKED;
+
+    int dest = move(direction, level.player, level);
+    if(level.map[dest] & WALL) return -1;
+
+    // If the player moves into a box, we try to push that box.
+    if(level.map[dest] & BOX)
+    {
+        if(!moveBox(direction, dest, level)) return -1;
+        entry |= PUSHED;
+    }
+
+    level.player = dest;
+
+    return entry;
+}
+
+int move(int direction, int src, const Level &level)
+{
+    switch(direction)
+    {
+        case LEFT: return src - 1;
+        case UP: return src - level.stride;
+        case RIGHT: return src + 1;
+        case DOWN: return src + level.stride;
+    }
+
+    return src;
+}
+
+bool moveBox(int direction, int src, Level &level)
+{
+    // We move the box if the destination does not
+    // contain a wall or another box.
+    int dest = move(direction, src, level);
+    if(!(level.map[dest] & (WALL | BOX)))
+    {
+        level.map[src] &= ~BOX;
+        level.map[dest] |= BOX;
+
+        // Increment remaining goals if the box was pushed off a goal.
+        if(level.map[src] & GOAL) level.goals++;
+
+        // Decrement remaining goals if the box was pushed onto a goal.
+        if(level.map[dest] & GOAL) level.goals--;
+
+        // Flag the level as lost if the box can no longer reach a goal,
+        // or if it is now frozen in place together with a box off a goal.
+        if((level.map[dest] & DEAD) || freezeDeadlock(level, dest))
+        {
+            level.deadlocked = true;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void startHistory(History &history, const Level &level)
+{
+    // Start an empty history, keeping the
+    // starting state of the level for restarts.
+    history.moves.clear();
+    history.snapshots.resize(1);
+    takeSnapshot(history.snapshots[0], level);
+    history.position = 0;
+}
+
+void takeSnapshot(Snapshot &snapshot, const Level &level)
+{
+    // Assigning a map of the same size reuses the snapshot's buffer.
+    snapshot.map = level.map;
+    snapshot.player = level.player;
+    snapshot.goals = level.goals;
+    snapshot.deadlocked = level.deadlocked;
+}
+
+int takeBack(Level &level, History &history)
+{
+    // Take back the last move. Returns its journal entry,
+    // or -1 if there is no move to take back.
+    if(history.position == 0) return -1;
+
+    uint8_t entry = history.moves[--history.position];
+    int step = move(DIRECTIONS[entry & 3], 0, level);
+
+    // Pull the box back to where the player stands.
+    if(entry & PUSHED)
+    {
+        int box = level.player + step;
+        level.map[box] &= ~BOX;
+        level.map[level.player] |= BOX;
+
+        if(level.map[box] & GOAL) level.goals++;
+        if(level.map[level.player] & GOAL) level.goals--;
+    }
+
+    level.player -= step;
+    level.deadlocked = entry & WAS_DEADLOCKED;
+
+    recordAction('-');
+    return entry;
+}
+
+int playAgain(Level &level, History &history)
+{
+    // Play the last move taken back again. Returns its journal
+    // entry, or -1 if there is no move to play again. It's
+    // recorded as a plain move, which has the same effect.
+    if(history.position == history.moves.size()) return -1;
+
+    int entry = applyMove(DIRECTIONS[history.moves[history.position++] & 3], level);
+
+    recordAction(moveChar(entry));
+    return entry;
+}
+
+void seek(Level &level, History &history, unsigned int position)
+{
+    // Restore the closest snapshot at or before position, then replay
+    // the journal from there. Restarting is a seek to position 0.
+    const Snapshot &snapshot = history.snapshots[position / SNAPSHOT_INTERVAL];
+    level.map = snapshot.map;
+    level.player = snapshot.player;
+    level.goals = snapshot.goals;
+    level.deadlocked = snapshot.deadlocked;
+
+    history.position = position / SNAPSHOT_INTERVAL * SNAPSHOT_INTERVAL;
+    while(history.position < position)
+    {
+        applyMove(DIRECTIONS[history.moves[history.position++] & 3], level);
+    }
+}
+
+int benchMove(Level &level, History &history, uint64_t &rng, bool &undone)
+{
+    // One step of the benchmarks' random walk. Take a move back one time
+    // in eight, otherwise move the first way the player can, starting from
+    // a random one. Returns the journal entry, or -1 if nothing moved.
+    uint64_t r = splitmix64(rng);
+
+    int entry = r % 8 == 0 ? takeBack(level, history) : -1;
+    undone = entry >= 0;
+    for(int i = 0; i < 4 && entry < 0; i++)
+    {
+        entry = play(DIRECTIONS[(r / 8 + i) % 4], level, history);
+    }
+
+    return entry;
+}
+
+void initCellSet(CellSet &set, const Level &level)
+{
+    set.words = (level.stride + 63) / 64;
+    set.bits.assign(set.words * (level.height + 2), 0);
+}
+
+bool hasCell(const CellSet &set, const Level &level, int cell)
+{
+    int x = cell % level.stride, y = cell / level.stride;
+    return (set.bits[y * set.words + x / 64] >> (x % 64)) & 1;
+}
+
+void setCell(CellSet &set, const Level &level, int cell, bool value)
+{
+    int x = cell % level.stride, y = cell / level.stride;
+    uint64_t bit = (uint64_t) 1 << (x % 64);
+
+    if(value)
+    {
+        set.bits[y * set.words + x / 64] |= bit;
+    }
+    else
+    {
+        set.bits[y * set.words + x / 64] &= ~bit;
+    }
+}
+
+void openCells(const Level &level, CellSet &open)
+{
+    // The cells the player may walk on: no wall and no box.
+    initCellSet(open, level);
+    for(unsigned int i = 0; i < level.map.size(); i++)
+    {
+        if(!(level.map[i] & (WALL | BOX))) setCell(open, level, i, true);
+    }
+}
+
+uint64_t fillUp(uint64_t reach, uint64_t open)
+{
+    // Spread reached bits towards higher bits through runs of open bits.
+    reach |= open & (reach << 1);
+    open &= open << 1;
+    reach |= open & (reach << 2);
+    open &= open << 2;
+    reach |= open & (reach << 4);
+    open &= open << 4;
+    reach |= open & (reach << 8);
+    open &= open << 8;
+    reach |= open & (reach << 16);
+    open &= open << 16;
+    return reach | (open & (reach << 32));
+}
+
+uint64_t fillDown(uint64_t reach, uint64_t open)
+{
+    // Spread reached bits towards lower bits through runs of open bits.
+    reach |= open & (reach >> 1);
+    open &= open >> 1;
+    reach |= open & (reach >> 2);
+    open &= open >> 2;
+    reach |= open & (reach >> 4);
+    open &= open >> 4;
+    reach |= open & (reach >> 8);
+    open &= open >> 8;
+    reach |= open & (reach >> 16);
+    open &= open >> 16;
+    return reach | (open & (reach >> 32));
+}
+
+void flood(const CellSet &open, const Level &level, int start, CellSet &reach)
+{
+    // Find every open cell connected to start, a word at a time. Each
+    // sweep pulls reached cells down (or up) from the neighbouring row,
+    // then spreads them along the row in both directions. Sweeps
+    // alternate direction until nothing changes.
+    initCellSet(reach, level);
+    setCell(reach, level, start, true);
+
+    int words = open.words, rows = level.height + 2;
+    bool changed = true;
+    for(int sweep = 0; changed; sweep++)
+    {
+        changed = false;
+
+        for(int k = 1; k < rows - 1; k++)
+        {
+            int y = sweep % 2 == 0 ? k : rows - 1 - k;
+            uint64_t* row = &reach.bits[y * words];
+            const uint64_t* free = &open.bits[y * words];
+
+            uint64_t any = 0;
+            for(int w = 0; w < words; w++)
+            {
+                uint64_t bits = row[w] | ((row[w - words] | row[w + words]) & free[w]);
+                any |= bits ^ row[w];
+                row[w] = bits;
+            }
+
+            // Spread along the row, carrying across word boundaries.
+            uint64_t carry = 0;
+            for(int w = 0; w < words; w++)
+            {
+                uint64_t bits = fillUp(row[w] | (carry & free[w]), free[w]);
+                any |= bits ^ row[w];
+                row[w] = bits;
+                carry = bits >> 63;
+            }
+
+            carry = 0;
+            for(int w = words - 1; w >= 0; w--)
+            {
+                uint64_t bits = fillDown(row[w] | ((carry << 63) & free[w]), free[w]);
+                any |= bits ^ row[w];
+                row[w] = bits;
+                carry = bits & 1;
+            }
+
+            if(any) changed = true;
+        }
+    }
+}
+
+void spreadCells(const CellSet &open, const CellSet &from, CellSet &to, int top, int bottom)
+{
+    // The open cells one step away from any cell in from, a word at a
+    // time, on rows top to bottom. The other rows of to are left alone.
+    int words = open.words;
+    for(int y = top; y <= bottom; y++)
+    {
+        const uint64_t* row = &from.bits[y * words];
+        for(int w = 0; w < words; w++)
+        {
+            uint64_t right = (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+            uint64_t left = (row[w] >> 1) | (w + 1 < words ? row[w + 1] << 63 : 0);
+            uint64_t bits = left | right | row[w - words] | row[w + words];
+
+            to.bits[y * words + w] = bits & open.bits[y * words + w];
+        }
+    }
+}
+
+bool findWalk(const Level &level, int from, int to, std::string &out)
+{
+    // Spread out from the player a step at a time, around walls and boxes,
+    // until to is reached, marking each cell with the step that reached it,
+    // counted modulo three. Cells next to each other are at most one step
+    // apart, so that is enough to trace the way back. Appends the moves in
+    // LURD notation and returns true if to is reachable. Each step only
+    // looks at the rows around the last. The scratch space is kept between
+    // calls, unless a level is bigger than WALK_KEEP_CELLS.
+    static thread_local CellSet open, seen, frontier, next;
+    static thread_local std::vector<uint8_t> step;
+
+    if(from == to) return true;
+    if(level.map[to] & (WALL | BOX)) return false;
+
+    openCells(level, open);
+    initCellSet(seen, level);
+    initCellSet(frontier, level);
+    initCellSet(next, level);
+    setCell(seen, level, from, true);
+    setCell(frontier, level, from, true);
+    step.assign(level.map.size(), 0);
+    step[from] = 1;
+
+    // The rows the frontier and next have cells on.
+    int words = open.words;
+    int top = from / level.stride, bottom = top;
+    int nextTop = 1, nextBottom = 0;
+
+    int steps = 0;
+    bool found = true;
+    while(!hasCell(frontier, level, to))
+    {
+        steps++;
+
+        std::fill(next.bits.begin() + nextTop * words, next.bits.begin() + (nextBottom + 1) * words, 0);
+        nextTop = std::max(top - 1, 1);
+        nextBottom = std::min(bottom + 1, level.height);
+        spreadCells(open, frontier, next, nextTop, nextBottom);
+
+        int first = -1, last = -1;
+        for(int i = nextTop * words; i < (nextBottom + 1) * words; i++)
+        {
+            uint64_t bits = next.bits[i] & ~seen.bits[i];
+            next.bits[i] = bits;
+            seen.bits[i] |= bits;
+            if(!bits) continue;
+
+            if(first < 0) first = i / words;
+            last = i / words;
+
+            int cell = (i / words) * level.stride + (i % words) * 64;
+            for(; bits; bits &= bits - 1)
+            {
+                step[cell + __builtin_ctzll(bits)] = steps % 3 + 1;
+            }
+        }
+
+        if(first < 0)
+        {
+            found = false;
+            break;
+        }
+
+        std::swap(frontier, next);
+        nextTop = top;
+        nextBottom = bottom;
+        top = first;
+        bottom = last;
+    }
+
+    if(found)
+    {
+        int offset[4] = {-1, -level.stride, 1, level.stride};
+        size_t end = out.size();
+        out.resize(end + steps);
+
+        int p = to;
+        for(int k = steps; k > 0; k--)
+        {
+            for(int d = 0; d < 4; d++)
+            {
+                if(step[p - offset[d]] != (k - 1) % 3 + 1) continue;
+
+                out[end + k - 1] = DIRECTION_CHARS[d];
+                p -= offset[d];
+                break;
+            }
+        }
+    }
+
+    if(level.map.size() > WALK_KEEP_CELLS)
+    {
+        open = CellSet();
+        seen = CellSet();
+        frontier = CellSet();
+        next = CellSet();
+        step = std::vector<uint8_t>();
+    }
+
+    return found;
+}
+
+bool labelSides(const Level &level, CellSet &open, CellSet &reach, int cell, int8_t* label, int &floods)
+{
+    // Label the four cells next to a box at cell, so that sides with the
+    // same label are connected without passing the box, and closed sides
+    // are -1. Usually the ring of eight cells around the box connects
+    // the open sides. Otherwise they are told apart with flood fills,
+    // which count down floods. Returns false once they run out.
+    int s = level.stride;
+    int ring[8] = {-s, -s + 1, 1, s + 1, s, s - 1, -1, -s - 1};
+    int sideAt[4] = {6, 0, 2, 4};
+
+    // Number the runs of open cells around the ring, joining the
+    // last run to the first if it wraps around.
+    int run[8], runs = 0;
+    for(int i = 0; i < 8; i++)
+    {
+        bool free = !(level.map[cell + ring[i]] & (WALL | BOX));
+        run[i] = !free ? -1 : (i > 0 && run[i - 1] >= 0) ? run[i - 1] : runs++;
+    }
+    if(run[0] >= 0 && run[7] >= 0)
+    {
+        int last = run[7];
+        for(int i = 7; i >= 0 && run[i] == last; i--) run[i] = run[0];
+    }
+
+    bool connected = true;
+    int first = -1;
+    for(int d = 0; d < 4; d++)
+    {
+        int r = run[sideAt[d]];
+        label[d] = r < 0 ? -1 : 0;
+        if(r < 0) continue;
+
+        if(first < 0) first = r;
+        if(r != first) connected = false;
+    }
+    if(connected) return true;
+
+    setCell(open, level, cell, false);
+    for(int d = 0; d < 4; d++) if(label[d] >= 0) label[d] = -2;
+
+    int labels = 0;
+    for(int d = 0; d < 4; d++)
+    {
+        if(label[d] != -2) continue;
+
+        if(--floods < 0)
+        {
+            setCell(open, level, cell, true);
+            return false;
+        }
+
+        flood(open, level, cell + ring[sideAt[d]], reach);
+        for(int e = d; e < 4; e++)
+        {
+            if(label[e] == -2 && hasCell(reach, level, cell + ring[sideAt[e]])) label[e] = labels;
+        }
+        labels++;
+    }
+    setCell(open, level, cell, true);
+
+    return true;
+}
+
+bool findPushPath(const Level &level, int box, int target, std::string &out)
+{
+    // Find the fewest pushes that bring the box at box to target, leaving
+    // every other box in place, and append the moves in LURD notation.
+    // A state is the box's cell and the direction it was last pushed in,
+    // which puts the player right behind it. The player can push from
+    // any side connected to that one, which is worked out once for each
+    // cell the box visits.
+    int offset[4] = {-1, -level.stride, 1, level.stride};
+    int size = level.map.size();
+
+    Level work = level;
+    work.map[box] &= ~BOX;
+
+    CellSet open, reach;
+    openCells(work, open);
+    int floods = PUSH_PATH_MAX_FLOODS;
+
+    // The sides of each cell, labelled as in labelSides, once visited.
+    std::vector<int8_t> sides(size * 4);
+    std::vector<char> labelled(size, 0);
+
+    // The player may start anywhere, so the first pushes need a flood.
+    setCell(open, work, box, false);
+    flood(open, work, level.player, reach);
+    setCell(open, work, box, true);
+
+    // States are numbered cell * 4 + direction. The search starts from
+    // the level as it is, numbered -1, and root marks it in parent.
+    int root = size * 4, found = -1;
+    std::vector<int> parent(size * 4, -1);
+    std::vector<int> queue{-1};
+
+    for(unsigned int head = 0; head < queue.size() && found < 0; head++)
+    {
+        int state = queue[head];
+        int from = state < 0 ? box : state / 4;
+
+        if(state >= 0 && !labelled[from])
+        {
+            if(!labelSides(work, open, reach, from, &sides[from * 4], floods)) return false;
+            labelled[from] = 1;
+        }
+
+        for(int d = 0; d < 4; d++)
+        {
+            int to = from + offset[d], next = to * 4 + d;
+            if((work.map[to] & WALL) || (work.map[to] & BOX) || parent[next] >= 0) continue;
+
+            // The player pushes from the side opposite d, and stands on
+            // the side opposite the last push.
+            int side = (d + 2) % 4;
+            bool reachable = state < 0 ? hasCell(reach, work, from - offset[d])
+                : sides[from * 4 + side] >= 0 && sides[from * 4 + side] == sides[from * 4 + (state % 4 + 2) % 4];
+            if(!reachable) continue;
+
+            parent[next] = state < 0 ? root : state;
+            queue.push_back(next);
+
+            if(to == target)
+            {
+                found = next;
+                break;
+            }
+        }
+    }
+
+    if(found < 0) return false;
+
+    std::vector<int> pushes;
+    for(int state = found; state != root; state = parent[state])
+    {
+        pushes.push_back(state);
+    }
+
+    // Walk to each push in turn, moving the box along as we go.
+    work.map[box] |= BOX;
+    for(int i = pushes.size() - 1; i >= 0; i--)
+    {
+        int d = pushes[i] % 4, to = pushes[i] / 4, from = to - offset[d];
+
+        if(!findWalk(work, work.player, from - offset[d], out)) return false;
+        out.push_back(toupper(DIRECTION_CHARS[d]));
+
+        work.map[from] &= ~BOX;
+        work.map[to] |= BOX;
+        work.player = from;
+    }
+
+    return true;
+}
+
+void findDeadSquares(Level &level)
+{
+    // Pull a box backwards from every goal at once. Pulling needs a free
+    // cell behind the box for the player. Any floor cell the box never
+    // reaches is dead: a box pushed there can never be brought to a goal.
+    // That only loses the level when every box is needed on a goal, so
+    // levels with more boxes than goals get no dead squares at all.
+    int offset[4] = {-1, -level.stride, 1, level.stride};
+    std::vector<uint8_t> live(level.map.size(), 0);
+    std::vector<int> queue;
+
+    int boxes = 0;
+    for(unsigned int i = 0; i < level.map.size(); i++)
+    {
+        if(level.map[i] & BOX) boxes++;
+        if(level.map[i] & GOAL)
+        {
+            live[i] = 1;
+            queue.push_back(i);
+        }
+    }
+
+    level.surplus = std::max(0, boxes - (int) queue.size());
+    if(level.surplus > 0) return;
+
+    for(unsigned int head = 0; head < queue.size(); head++)
+    {
+        int p = queue[head];
+        for(int d = 0; d < 4; d++)
+        {
+            int prev = p - offset[d];
+            if(live[prev] || (level.map[prev] & WALL) || (level.map[prev - offset[d]] & WALL)) continue;
+
+            live[prev] = 1;
+            queue.push_back(prev);
+        }
+    }
+
+    for(unsigned int i = 0; i < level.map.size(); i++)
+    {
+        if(!live[i] && !(level.map[i] & WALL)) level.map[i] |= DEAD;
+    }
+}
+
+bool isFrozen(Level &level, int cell, bool &offGoal)
+{
+    // A box is frozen when it can move along neither axis. While its
+    // neighbours are checked it stands in as a wall, which both stops
+    // the recursion and accounts for boxes that block each other.
+    uint8_t saved = level.map[cell];
+    level.map[cell] |= WALL;
+
+    bool clusterOffGoal = !(saved & GOAL);
+    bool frozen = isBlocked(level, cell, 1, clusterOffGoal) && isBlocked(level, cell, level.stride, clusterOffGoal);
+
+    level.map[cell] = saved;
+
+    if(frozen && clusterOffGoal) offGoal = true;
+    return frozen;
+}
+
+bool isBlocked(Level &level, int cell, int step, bool &offGoal)
+{
+    // Check whether the box at cell is stuck along the axis given by step.
+    uint8_t before = level.map[cell - step], after = level.map[cell + step];
+
+    if((before & WALL) || (after & WALL)) return true;
+    if((before & DEAD) && (after & DEAD)) return true;
+    if((before & BOX) && isFrozen(level, cell - step, offGoal)) return true;
+    if((after & BOX) && isFrozen(level, cell + step, offGoal)) return true;
+
+    return false;
+}
+
+bool freezeDeadlock(Level &level, int cell)
+{
+    // True when the box at cell is frozen along with a box that is not
+    // on a goal. Spare boxes may be left anywhere, frozen or not.
+    if(level.surplus > 0) return false;
+
+    bool offGoal = false;
+    return isFrozen(level, cell, offGoal) && offGoal;
+}
+
+// Solver.
+//
+// An IDA* search over box positions. States are hashed with Zobrist keys
+// and kept in a fixed-size transposition table, and the search is guided
+// by the cost of a minimum matching between goals and boxes, where each
+// box-to-goal cost is the number of pushes needed when ignoring other boxes.
+// Pushes onto dead squares or into freeze deadlocks are never tried,
+// unless the level has spare boxes.
+
+const int UNREACHABLE = 1 << 20;
+
+struct Push
+{
+    int box, dir;  // Cell the box is pushed from, and the direction of the push.
+};
+
+struct Candidate
+{
+    int box, dir, cost;
+};
+
+struct TableEntry
+{
+    uint64_t key;
+    uint32_t g, iteration;
+};
+
+// Each thread keeps its transposition table from one solve to the next.
+// Entries are stamped with the iteration that wrote them, and the count
+// carries on across solves, so old entries never need clearing.
+struct TranspositionTable
+{
+    std::vector<TableEntry> entries;
+    uint32_t iteration;
+};
+
+thread_local TranspositionTable transpositions{{}, 0};
+
+struct Search
+{
+    SolveOptions options;
+
+    // A private copy of the level, kept in step with the search.
+    Level level;
+    int offset[4];
+    std::vector<int> goals, boxes, boxAt;
+    std::vector<std::vector<int>> distance;
+    int player;
+
+    std::vector<uint64_t> boxKeys, playerKeys;
+    uint64_t boxHash;
+    std::vector<TableEntry>* table;
+    uint32_t iteration;
+
+    // Scratch space for the player flood fill.
+    std::vector<uint32_t> mark;
+    std::vector<int> walk, queue;
+    uint32_t stamp;
+
+    // Scratch space for the matching.
+    std::vector<int> u, v, match, way, minv;
+    std::vector<char> used;
+
+    std::vector<std::vector<Candidate>> candidates;
+    std::vector<Push> path;
+    int nextBound;
+    long long nodes;
+    bool aborted;
+};
+
+void initSearch(Search &s, const Level &level, const SolveOptions &options)
+{
+    s.options = options;
+    s.level = level;
+
+    s.offset[0] = -1;
+    s.offset[1] = -level.stride;
+    s.offset[2] = 1;
+    s.offset[3] = level.stride;
+
+    int size = level.map.size();
+    s.boxAt.assign(size, -1);
+    s.goals.clear();
+    s.boxes.clear();
+
+    for(int i = 0; i < size; i++)
+    {
+        if(level.map[i] & GOAL) s.goals.push_back(i);
+        if(level.map[i] & BOX)
+        {
+            s.boxAt[i] = s.boxes.size();
+            s.boxes.push_back(i);
+        }
+    }
+
+    s.player = level.player;
+
+    // Count pushes from every cell to every goal by pulling a box
+    // backwards from the goal. The player needs a free cell behind
+    // the box for every pull.
+    s.distance.assign(s.goals.size(), std::vector<int>(size, UNREACHABLE));
+    for(unsigned int g = 0; g < s.goals.size(); g++)
+    {
+        std::vector<int> &dist = s.distance[g];
+        std::vector<int> queue{s.goals[g]};
+        dist[s.goals[g]] = 0;
+
+        for(unsigned int head = 0; head < queue.size(); head++)
+        {
+            int p = queue[head];
+            for(int d = 0; d < 4; d++)
+            {
+                int prev = p - s.offset[d];
+                if((level.map[prev] & WALL) || (level.map[prev - s.offset[d]] & WALL) || dist[prev] != UNREACHABLE) continue;
+
+                dist[prev] = dist[p] + 1;
+                queue.push_back(prev);
+            }
+        }
+    }
+
+    // Zobrist keys for boxes and the player.
+    uint64_t seed = 0x5EED;
+    s.boxKeys.resize(size);
+    s.playerKeys.resize(size);
+    for(int i = 0; i < size; i++)
+    {
+        s.boxKeys[i] = splitmix64(seed);
+        s.playerKeys[i] = splitmix64(seed);
+    }
+
+    s.boxHash = 0;
+    for(unsigned int b = 0; b < s.boxes.size(); b++) s.boxHash ^= s.boxKeys[s.boxes[b]];
+
+    size_t entries = (size_t) 1 << options.tableBits;
+    if(transpositions.entries.size() != entries)
+    {
+        transpositions.entries.assign(entries, TableEntry{0, 0, 0});
+        transpositions.iteration = 0;
+    }
+    s.table = &transpositions.entries;
+    s.iteration = transpositions.iteration;
+
+    s.mark.assign(size, 0);
+    s.walk.assign(size, 0);
+    s.queue.resize(size);
+    s.stamp = 0;
+
+    int n = s.goals.size(), m = s.boxes.size();
+    s.u.assign(n + 1, 0);
+    s.v.assign(m + 1, 0);
+    s.match.assign(m + 1, 0);
+    s.way.assign(m + 1, 0);
+    s.minv.assign(m + 1, 0);
+    s.used.assign(m + 1, 0);
+
+    s.path.clear();
+    s.nodes = 0;
+    s.aborted = false;
+}
+
+int lowerBound(Search &s)
+{
+    // Minimum cost assignment of a distinct box to every goal
+    // (the Hungarian algorithm, goals as rows and boxes as columns).
+    int n = s.goals.size(), m = s.boxes.size();
+    if(m < n) return UNREACHABLE;
+
+    std::fill(s.u.begin(), s.u.end(), 0);
+    std::fill(s.v.begin(), s.v.end(), 0);
+    std::fill(s.match.begin(), s.match.end(), 0);
+
+    for(int i = 1; i <= n; i++)
+    {
+        s.match[0] = i;
+        int j0 = 0;
+        std::fill(s.minv.begin(), s.minv.end(), 1 << 30);
+        std::fill(s.used.begin(), s.used.end(), 0);
+
+        do
+        {
+            s.used[j0] = 1;
+            int i0 = s.match[j0], delta = 1 << 30, j1 = 0;
+            const std::vector<int> &dist = s.distance[i0 - 1];
+
+            for(int j = 1; j <= m; j++)
+            {
+                if(s.used[j]) continue;
+
+                int cur = dist[s.boxes[j - 1]] - s.u[i0] - s.v[j];
+                if(cur < s.minv[j])
+                {
+                    s.minv[j] = cur;
+                    s.way[j] = j0;
+                }
+                if(s.minv[j] < delta)
+                {
+                    delta = s.minv[j];
+                    j1 = j;
+                }
+            }
+
+            for(int j = 0; j <= m; j++)
+            {
+                if(s.used[j])
+                {
+                    s.u[s.match[j]] += delta;
+                    s.v[j] -= delta;
+                }
+                else
+                {
+                    s.minv[j] -= delta;
+                }
+            }
+
+            j0 = j1;
+        }
+        while(s.match[j0] != 0);
+
+        do
+        {
+            int j1 = s.way[j0];
+            s.match[j0] = s.match[j1];
+            j0 = j1;
+        }
+        while(j0);
+    }
+
+    int cost = -s.v[0];
+    return cost >= UNREACHABLE ? UNREACHABLE : cost;
+}
+
+int expand(Search &s, std::vector<Candidate> &moves)
+{
+    // Flood fill the cells the player can reach, and collect every push
+    // that leaves the box on a live square. Returns the player position
+    // that identifies this state: the top-left reachable cell when
+    // counting pushes, or the exact cell when counting moves.
+    if(++s.stamp == 0)
+    {
+        std::fill(s.mark.begin(), s.mark.end(), 0);
+        s.stamp = 1;
+    }
+
+    int head = 0, tail = 0, normal = s.player;
+    s.queue[tail++] = s.player;
+    s.mark[s.player] = s.stamp;
+    s.walk[s.player] = 0;
+
+    while(head < tail)
+    {
+        int p = s.queue[head++];
+        if(p < normal) normal = p;
+
+        for(int d = 0; d < 4; d++)
+        {
+            int q = p + s.offset[d];
+            if((s.level.map[q] & WALL) || s.mark[q] == s.stamp) continue;
+
+            if(s.level.map[q] & BOX)
+            {
+                int to = q + s.offset[d];
+                if(!(s.level.map[to] & (WALL | BOX | DEAD)))
+                {
+                    int cost = s.options.optimizeMoves ? s.walk[p] + 1 : 1;
+                    moves.push_back(Candidate{s.boxAt[q], d, cost});
+                }
+                continue;
+            }
+
+            s.mark[q] = s.stamp;
+            s.walk[q] = s.walk[p] + 1;
+            s.queue[tail++] = q;
+        }
+    }
+
+    return s.options.optimizeMoves ? s.player : normal;
+}
+
+void moveSearchBox(Search &s, int b, int to)
+{
+    int from = s.boxes[b];
+    s.boxAt[from] = -1;
+    s.boxAt[to] = b;
+    s.boxes[b] = to;
+    s.level.map[from] &= ~BOX;
+    s.level.map[to] |= BOX;
+    s.boxHash ^= s.boxKeys[from] ^ s.boxKeys[to];
+}
+
+bool searchNode(Search &s, int g, int bound)
+{
+    if((s.options.maxNodes && s.nodes >= s.options.maxNodes) || (s.options.cancel && *s.options.cancel))
+    {
+        s.aborted = true;
+        return false;
+    }
+    s.nodes++;
+
+    int h = lowerBound(s);
+    if(h >= UNREACHABLE) return false;
+    if(g + h > bound)
+    {
+        if(g + h < s.nextBound) s.nextBound = g + h;
+        return false;
+    }
+
+    // Every goal holds a box.
+    if(h == 0) return true;
+
+    std::vector<Candidate> &moves = s.candidates[s.path.size()];
+    moves.clear();
+    int normal = expand(s, moves);
+
+    // Skip states already reached at least as cheaply during this iteration.
+    uint64_t key = s.boxHash ^ s.playerKeys[normal];
+    TableEntry &entry = (*s.table)[key & (s.table->size() - 1)];
+    if(entry.key == key && entry.iteration == s.iteration && (int) entry.g <= g) return false;
+    entry = TableEntry{key, (uint32_t) g, s.iteration};
+
+    for(unsigned int i = 0; i < moves.size(); i++)
+    {
+        Candidate c = moves[i];
+        int from = s.boxes[c.box], to = from + s.offset[c.dir];
+        int player = s.player;
+
+        moveSearchBox(s, c.box, to);
+        s.player = from;
+        s.path.push_back(Push{from, c.dir});
+
+        if(!freezeDeadlock(s.level, to) && searchNode(s, g + c.cost, bound)) return true;
+
+        s.path.pop_back();
+        s.player = player;
+        moveSearchBox(s, c.box, from);
+
+        if(s.aborted) return false;
+    }
+
+    return false;
+}
+
+SolveResult solve(const Level &level, const SolveOptions &options)
+{
+    SolveResult result{false, false, "", 0, 0, 0.0, 0};
+
+    // A level that can't be played has nothing to search.
+    if(levelError(level)) return result;
+
+    auto start = std::chrono::steady_clock::now();
+
+    Search s;
+    initSearch(s, level, options);
+
+    int bound = lowerBound(s);
+    while(bound < UNREACHABLE && !s.aborted)
+    {
+        if(++s.iteration == 0)
+        {
+            std::fill(s.table->begin(), s.table->end(), TableEntry{0, 0, 0});
+            s.iteration = 1;
+        }
+        s.nextBound = UNREACHABLE;
+        s.candidates.resize(bound + 2);
+
+        if(searchNode(s, 0, bound))
+        {
+            result.solved = true;
+            break;
+        }
+
+        bound = s.nextBound;
+    }
+
+    if(result.solved)
+    {
+        // Undo the pushes, then replay them to spell out the player's moves.
+        for(int i = s.path.size() - 1; i >= 0; i--)
+        {
+            const Push &push = s.path[i];
+            moveSearchBox(s, s.boxAt[push.box + s.offset[push.dir]], push.box);
+        }
+        s.player = s.level.player = level.player;
+
+        for(unsigned int i = 0; i < s.path.size(); i++)
+        {
+            const Push &push = s.path[i];
+            findWalk(s.level, s.player, push.box - s.offset[push.dir], result.moves);
+            result.moves.push_back(toupper(DIRECTION_CHARS[push.dir]));
+
+            moveSearchBox(s, s.boxAt[push.box], push.box + s.offset[push.dir]);
+            s.player = s.level.player = push.box;
+        }
+
+        result.pushes = s.path.size();
+    }
+
+    result.gaveUp = !result.solved && s.aborted;
+    result.nodes = s.nodes;
+    transpositions.iteration = s.iteration;
+
+    result.memory = s.level.map.capacity() + s.table->capacity() * sizeof(TableEntry)
+        + s.distance.size() * s.level.map.size() * sizeof(int)
+        + (s.mark.capacity() + s.walk.capacity() + s.queue.capacity()) * sizeof(int);
+    for(unsigned int i = 0; i < s.candidates.size(); i++)
+    {
+        result.memory += s.candidates[i].capacity() * sizeof(Candidate);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+int solveFromCommandLine(int number, const SolveOptions &options)
+{
+    if(number < 1 || number > (int) levels.count)
+    {
+        printf("Error: there is no level %d, the file has %d levels.\n", number, (int) levels.count);
+        return 1;
+    }
+
+    Level level = readLevel(levels, number - 1);
+    if(const char* error = levelError(level))
+    {
+        printf("Level %d %s, so it can't be solved.\n", number, error);
+        return 1;
+    }
+
+    SolveResult result = solve(level, options);
+
+    if(result.gaveUp)
+    {
+        printf("Level %d: gave up after %lld states in %.2fs, use --max-nodes for a higher limit (0 for none).\n",
+            number, result.nodes, result.seconds);
+        return 1;
+    }
+
+    if(!result.solved)
+    {
+        printf("Level %d: no solution (%lld states expanded in %.2fs).\n", number, result.nodes, result.seconds);
+        return 1;
+    }
+
+    printf("Level %d: %d pushes, %d moves (%lld states expanded in %.2fs, %.0f states/s).\n",
+        number, result.pushes, (int) result.moves.size(), result.nodes, result.seconds, result.nodes / std::max(result.seconds, 1e-9));
+    printf("%s\n", result.moves.c_str());
+
+    return 0;
+}
+
+int takeJob(int id, std::vector<WorkQueue> &queues)
+{
+    // Take the next job from the back of our own queue, or steal one
+    // from the front of another. No work is added once the workers
+    // start, so -1, every queue empty, means we are done.
+    for(unsigned int k = 0; k < queues.size(); k++)
+    {
+        WorkQueue &queue = queues[(id + k) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+
+        if(queue.jobs.empty()) continue;
+
+        int job;
+        if(k == 0)
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+
+        return job;
+    }
+
+    return -1;
+}
+
+void verifyWorker(int id, std::vector<WorkQueue> &queues, const SolveOptions &options, std::vector<SolveResult> &results)
+{
+    for(int job = takeJob(id, queues); job >= 0; job = takeJob(id, queues))
+    {
+        results[job] = solve(readLevel(levels, job), options);
+    }
+}
+
+int verifyAll(int threads, const SolveOptions &options)
+{
+    if(threads < 1) threads = 1;
+    if(threads > (int) levels.count) threads = levels.count;
+
+    // Each worker gets a smaller transposition table, so
+    // memory use stays about the same with more threads.
+    SolveOptions workerOptions = options;
+    while(workerOptions.tableBits > 16 && (1 << (options.tableBits - workerOptions.tableBits)) < threads)
+    {
+        workerOptions.tableBits--;
+    }
+
+    // Deal the levels out round robin, so every worker
+    // starts with a mix of early and late levels.
+    std::vector<WorkQueue> queues(threads);
+    for(int i = 0; i < levels.count; i++)
+    {
+        queues[i % threads].jobs.push_back(i);
+    }
+
+    std::vector<SolveResult> results(levels.count);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for(int id = 0; id < threads; id++)
+    {
+        workers.push_back(std::thread(verifyWorker, id, std::ref(queues), std::cref(workerOptions), std::ref(results)));
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int failed = 0;
+    long long nodes = 0;
+    for(unsigned int i = 0; i < results.size(); i++)
+    {
+        const SolveResult &result = results[i];
+        nodes += result.nodes;
+
+        if(result.solved)
+        {
+            printf("Level %d: %d pushes, %d moves, %lld states, %.3fs, %.1f MB\n",
+                i + 1, result.pushes, (int) result.moves.size(), result.nodes, result.seconds, result.memory / 1048576.0);
+        }
+        else if(const char* error = levelError(readLevel(levels, i)))
+        {
+            printf("Level %d: UNSOLVED, it %s\n", i + 1, error);
+            failed++;
+        }
+        else
+        {
+            printf("Level %d: UNSOLVED%s, %lld states, %.3fs, %.1f MB\n",
+                i + 1, result.gaveUp ? " (gave up)" : "", result.nodes, result.seconds, result.memory / 1048576.0);
+            failed++;
+        }
+    }
+
+    // Levels left out when the file was loaded count as failures too.
+    if(levels.skipped > 0)
+    {
+        printf("%d levels of the file can't be played, and were left out.\n", levels.skipped);
+        failed += levels.skipped;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%d of %d levels solved on %d threads in %.2fs, %lld states expanded, peak memory %.1f MB.\n",
+        (int) levels.count + levels.skipped - failed, (int) levels.count + levels.skipped, threads, seconds, nodes, usage.ru_maxrss / 1024.0);
+
+    return failed == 0 ? 0 : 1;
+}
+
+bool carveRoom(Level &level, const GenerateOptions &options, uint64_t &rng)
+{
+    // Carve small rectangles out of solid wall until about half of the
+    // inside of the room is floor, then place the player and wall off
+    // any floor they can't reach. Fails if too little floor is left.
+    level.width = options.width;
+    level.height = options.height;
+    level.stride = options.width + 2;
+    level.goals = 0;
+    level.deadlocked = false;
+    level.surplus = 0;
+    level.map.assign(level.stride * (level.height + 2), WALL);
+
+    int inside = (level.width - 2) * (level.height - 2), floor = 0;
+    while(floor * 2 < inside)
+    {
+        int w = 1 + splitmix64(rng) % std::min(3, level.width - 2);
+        int h = 1 + splitmix64(rng) % std::min(3, level.height - 2);
+        int x = 2 + splitmix64(rng) % (level.width - 1 - w);
+        int y = 2 + splitmix64(rng) % (level.height - 1 - h);
+
+        for(int j = y; j < y + h; j++)
+        {
+            for(int i = x; i < x + w; i++)
+            {
+                if(level.map[j * level.stride + i] & WALL) floor++;
+                level.map[j * level.stride + i] = 0;
+            }
+        }
+    }
+
+    std::vector<int> cells;
+    for(unsigned int i = 0; i < level.map.size(); i++)
+    {
+        if(!(level.map[i] & WALL)) cells.push_back(i);
+    }
+    level.player = cells[splitmix64(rng) % cells.size()];
+
+    CellSet open, reach;
+    openCells(level, open);
+    flood(open, level, level.player, reach);
+
+    floor = 0;
+    for(unsigned int i = 0; i < level.map.size(); i++)
+    {
+        if(level.map[i] & WALL) continue;
+
+        if(hasCell(reach, level, i))
+        {
+            floor++;
+        }
+        else
+        {
+            level.map[i] = WALL;
+        }
+    }
+
+    return floor >= 2 * options.boxes + 4;
+}
+
+void pullBoxes(Level &level, int steps, uint64_t &rng)
+{
+    // Play backwards: the player walks at random, pulling along any box
+    // behind them three times in four. A pull undoes a push, so every
+    // box can still be pushed back to where it started.
+    int offset[4] = {-1, -level.stride, 1, level.stride};
+    for(int i = 0; i < steps; i++)
+    {
+        uint64_t r = splitmix64(rng);
+        int d = r % 4;
+        int to = level.player + offset[d], behind = level.player - offset[d];
+        if(level.map[to] & (WALL | BOX)) continue;
+
+        if((level.map[behind] & BOX) && (r >> 2) % 4 != 0)
+        {
+            level.map[behind] &= ~BOX;
+            level.map[level.player] |= BOX;
+        }
+
+        level.player = to;
+    }
+}
+
+int countBoxChanges(Level level, const std::string &moves)
+{
+    // Count how often a solution turns to a box other than the one it
+    // pushed last. Levels where the boxes must take turns get in each
+    // other's way, and are harder than their number of pushes suggests.
+    int offset[4] = {-1, -level.stride, 1, level.stride};
+    int changes = 0, last = -1;
+    for(unsigned int i = 0; i < moves.size(); i++)
+    {
+        int d = strchr(DIRECTION_CHARS, tolower(moves[i])) - DIRECTION_CHARS;
+        if(isupper(moves[i]))
+        {
+            int box = level.player + offset[d];
+            if(box != last) changes++;
+            last = box + offset[d];
+        }
+
+        applyMove(DIRECTIONS[d], level);
+    }
+
+    return changes;
+}
+
+Generated generateLevel(int number, const GenerateOptions &options, const SolveOptions &solveOptions)
+{
+    // Try a number of rooms for this level, and keep the one whose
+    // push-optimal solution scores highest. Each level has its own
+    // random numbers, so the results don't depend on the thread count.
+    uint64_t key = options.seed ^ ((uint64_t) number << 32);
+    uint64_t rng = splitmix64(key);
+
+    Generated best{"", 0, 0, 0, -1};
+    for(int candidate = 0; candidate < options.candidates; candidate++)
+    {
+        Level level;
+        if(!carveRoom(level, options, rng)) continue;
+
+        // Put the boxes on goals, away from the player.
+        std::vector<int> cells;
+        for(unsigned int i = 0; i < level.map.size(); i++)
+        {
+            if(!(level.map[i] & WALL) && (int) i != level.player) cells.push_back(i);
+        }
+        for(int b = 0; b < options.boxes; b++)
+        {
+            std::swap(cells[b], cells[b + splitmix64(rng) % (cells.size() - b)]);
+            level.map[cells[b]] = GOAL | BOX;
+        }
+
+        pullBoxes(level, GENERATE_PULL_STEPS * (int) cells.size(), rng);
+
+        for(unsigned int i = 0; i < level.map.size(); i++)
+        {
+            if((level.map[i] & (GOAL | BOX)) == GOAL) level.goals++;
+        }
+        findDeadSquares(level);
+
+        SolveResult result = solve(level, solveOptions);
+        if(!result.solved || result.pushes == 0) continue;
+
+        int changes = countBoxChanges(level, result.moves);
+        int score = result.pushes + GENERATE_CHANGE_WEIGHT * changes;
+        if(score > best.score)
+        {
+            best = Generated{levelText(level), result.pushes, (int) result.moves.size(), changes, score};
+        }
+    }
+
+    return best;
+}
+
+void generateWorker(int id, std::vector<WorkQueue> &queues, const GenerateOptions &options,
+    const SolveOptions &solveOptions, std::vector<Generated> &results)
+{
+    for(int job = takeJob(id, queues); job >= 0; job = takeJob(id, queues))
+    {
+        results[job] = generateLevel(job, options, solveOptions);
+    }
+}
+
+int generateLevels(int count, const char* path, int threads, const GenerateOptions &options)
+{
+    // Generate levels on every thread, then write them in the format of
+    // the level file, easiest first by score.
+    if(count < 1 || options.width < 5 || options.height < 5 || options.boxes < 1 || options.candidates < 1)
+    {
+        printf("Error: generate at least one level, from at least one candidate room of at least 5x5 with at least one box.\n");
+        return 1;
+    }
+
+    if(threads < 1) threads = 1;
+    if(threads > count) threads = count;
+
+    std::vector<WorkQueue> queues(threads);
+    for(int i = 0; i < count; i++)
+    {
+        queues[i % threads].jobs.push_back(i);
+    }
+
+    std::vector<Generated> results(count);
+
+    // Rooms are small, so a small transposition table is plenty, and
+    // a candidate the solver struggles with is simply passed over.
+    SolveOptions solveOptions{false, GENERATE_MAX_NODES, 16, nullptr};
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for(int id = 0; id < threads; id++)
+    {
+        workers.push_back(std::thread(generateWorker, id, std::ref(queues), std::cref(options),
+            std::cref(solveOptions), std::ref(results)));
+    }
+    for(unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::stable_sort(results.begin(), results.end(), [](const Generated &a, const Generated &b)
+    {
+        return a.score < b.score;
+    });
+
+    FILE* file = fopen(path, "w");
+    if(!file)
+    {
+        printf("Error: could not write '%s'.\n", path);
+        return 1;
+    }
+
+    int written = 0;
+    for(unsigned int i = 0; i < results.size(); i++)
+    {
+        const Generated &level = results[i];
+        if(level.score < 0) continue;
+
+        fprintf(file, "%s,\n", level.text.c_str());
+        written++;
+
+        printf("Level %d: score %d, %d pushes, %d moves, %d box changes\n",
+            written, level.score, level.pushes, level.moves, level.changes);
+    }
+    fclose(file);
+
+    printf("%d of %d levels generated on %d threads in %.2fs, written to '%s'.\n",
+        written, count, threads, seconds, path);
+
+    return written == count ? 0 : 1;
+}
+
+uint64_t canonicalHash(const Level &level)
+{
+    // A hash that is the same for every way of writing down the same
+    // puzzle. Only the cells the player could ever walk on count, cut
+    // down to the rectangle around them, and the player is replaced by
+    // the area they can reach before pushing anything. Each of the
+    // eight rotations and mirror images of that is hashed, and the
+    // smallest hash is the canonical one.
+    CellSet open, inside, reach;
+    initCellSet(open, level);
+    for(unsigned int i = 0; i < level.map.size(); i++)
+    {
+        if(!(level.map[i] & WALL)) setCell(open, level, i, true);
+    }
+    flood(open, level, level.player, inside);
+
+    openCells(level, open);
+    flood(open, level, level.player, reach);
+
+    int left = level.stride, top = level.height + 2, right = -1, bottom = -1;
+    for(unsigned int i = 0; i < level.map.size(); i++)
+    {
+        if(!hasCell(inside, level, i)) continue;
+
+        int x = i % level.stride, y = i / level.stride;
+        left = std::min(left, x);
+        right = std::max(right, x);
+        top = std::min(top, y);
+        bottom = std::max(bottom, y);
+    }
+
+    // One byte per cell: 0 outside, otherwise 1, plus the goal and box
+    // flags, plus 8 where the player can reach.
+    int w = right - left + 1, h = bottom - top + 1;
+    std::vector<uint8_t> cells(w * h, 0);
+    for(int y = 0; y < h; y++)
+    {
+        for(int x = 0; x < w; x++)
+        {
+            int cell = (top + y) * level.stride + left + x;
+            if(!hasCell(inside, level, cell)) continue;
+
+            cells[y * w + x] = 1 | (level.map[cell] & (GOAL | BOX)) | (hasCell(reach, level, cell) ? 8 : 0);
+        }
+    }
+
+    uint64_t best = UINT64_MAX;
+    std::vector<uint8_t> buffer(w * h + 4);
+    for(int symmetry = 0; symmetry < 8; symmetry++)
+    {
+        bool transpose = symmetry & 4;
+        int tw = transpose ? h : w, th = transpose ? w : h;
+
+        buffer[0] = tw & 0xFF;
+        buffer[1] = tw >> 8;
+        buffer[2] = th & 0xFF;
+        buffer[3] = th >> 8;
+        for(int ty = 0; ty < th; ty++)
+        {
+            for(int tx = 0; tx < tw; tx++)
+            {
+                int x = transpose ? ty : tx, y = transpose ? tx : ty;
+                if(symmetry & 1) x = w - 1 - x;
+                if(symmetry & 2) y = h - 1 - y;
+
+                buffer[4 + ty * tw + tx] = cells[y * w + x];
+            }
+        }
+
+        best = std::min(best, fnvBytes(FNV_OFFSET, buffer.data(), buffer.size()));
+    }
+
+    return best;
+}
+
+int dedupeLevels(const char* from, const char* to)
+{
+    // Copy the levels of one file to another in a single pass, leaving
+    // out any level with the same canonical hash as one already copied.
+    // Levels that are kept are copied as they were written. Levels that
+    // can't be played are left out too, and named.
+    struct stat fromInfo, toInfo;
+    if(stat(from, &fromInfo) == 0 && stat(to, &toInfo) == 0
+        && fromInfo.st_dev == toInfo.st_dev && fromInfo.st_ino == toInfo.st_ino)
+    {
+        printf("Error: '%s' can't be deduplicated into itself.\n", from);
+        return 1;
+    }
+
+    LevelPack pack{nullptr, 0, {}, nullptr, 0, 0, 0};
+    if(!indexLevels(from, pack)) return 1;
+
+    FILE* file = fopen(to, "w");
+    if(!file)
+    {
+        printf("Error: could not write '%s'.\n", to);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    madvise((void*) pack.data, pack.size, MADV_SEQUENTIAL);
+
+    std::unordered_set<uint64_t> seen;
+    seen.reserve(pack.count);
+
+    int kept = 0, invalid = 0;
+    for(int i = 0; i < pack.count; i++)
+    {
+        const LevelSpan &span = pack.index[i];
+        Level level = readLevel(pack, i);
+        if(const char* error = levelError(level))
+        {
+            printf("Warning: level %d of '%s' %s, so it is left out.\n", i + 1, from, error);
+            invalid++;
+            continue;
+        }
+
+        if(!seen.insert(canonicalHash(level)).second) continue;
+
+        fwrite(pack.data + span.begin, 1, span.end - span.begin, file);
+        fputs(",\n", file);
+        kept++;
+    }
+
+    bool failed = ferror(file);
+    if(fclose(file) != 0 || failed)
+    {
+        printf("Error: could not write '%s'.\n", to);
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Kept %d of %d levels from '%s' in '%s', %d duplicates and %d unplayable levels dropped in %.2fs.\n",
+        kept, pack.count, from, to, pack.count - kept - invalid, invalid, seconds);
+
+    return 0;
+}
+
+bool startRecording(const char* path)
+{
+    recording.file = fopen(path, "w");
+    if(!recording.file)
+    {
+        printf("Could not write replay to '%s'!\n", path);
+        return false;
+    }
+
+    fprintf(recording.file, "%s\n", REPLAY_MAGIC);
+    recording.column = 0;
+    return true;
+}
+
+void recordLevel(int number)
+{
+    if(!recording.file) return;
+
+    fprintf(recording.file, "level %d\n", number + 1);
+    recording.column = 0;
+}
+
+void recordAction(char action)
+{
+    if(!recording.file) return;
+
+    if(recording.column == REPLAY_COLUMNS)
+    {
+        fputc('\n', recording.file);
+        recording.column = 0;
+    }
+
+    fputc(action, recording.file);
+    recording.column++;
+}
+
+void recordEnd(const Level &level)
+{
+    if(!recording.file) return;
+
+    if(recording.column > 0) fputc('\n', recording.file);
+    fprintf(recording.file, "end %016llx\n", (unsigned long long) hashLevel(level));
+    recording.column = 0;
+}
+
+char moveChar(int entry)
+{
+    // A journal entry in LURD notation.
+    char c = DIRECTION_CHARS[entry & 3];
+    return (entry & PUSHED) ? toupper(c) : c;
+}
+
+uint64_t hashLevel(const Level &level)
+{
+    // A hash of everything that can change as the level is played.
+    uint64_t hash = fnvBytes(FNV_OFFSET, level.map.data(), level.map.size());
+    return fnvMix(hash, (uint32_t) level.player);
+}
+
+int playAction(char action, Level &level, History &history)
+{
+    // Play one action of a replay. A move must be possible, and push
+    // a box exactly when the replay says it does. Returns the journal
+    // entry of the move or undo, RESTARTED for a restart, or -1 if the
+    // action can't be played.
+    if(action == '-') return takeBack(level, history);
+
+    if(action == '*')
+    {
+        seek(level, history, 0);
+        return RESTARTED;
+    }
+
+    const char* d = strchr(DIRECTION_CHARS, tolower(action));
+    if(!d || action == 0) return -1;
+
+    int entry = play(DIRECTIONS[d - DIRECTION_CHARS], level, history);
+    if(entry < 0 || bool(entry & PUSHED) != bool(isupper(action))) return -1;
+
+    return entry;
+}
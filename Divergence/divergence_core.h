@@ -0,0 +1,236 @@
+/*
+ * Divergence (a Sokoban (or Sokouban if you're a purist) clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DIVERGENCE_CORE_H
+#define DIVERGENCE_CORE_H
+
+#include "hash.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#include <stdio.h>
+
+// Directions in the order used by LURD solution strings.
+const int LEFT = 0;
+const int UP = 1;
+const int RIGHT = 2;
+const int DOWN = 3;
+
+constexpr int DIRECTIONS[4] = {LEFT, UP, RIGHT, DOWN};
+const char DIRECTION_CHARS[] = "lurd";
+
+// Cell flags. A cell without any is empty floor.
+const uint8_t WALL = 1;
+const uint8_t GOAL = 2;
+const uint8_t BOX = 4;
+const uint8_t DEAD = 8;  // No box pushed here can ever reach a goal.
+
+
+struct Level
+{
+    int width, height, goals;
+
+    // Set once a push leaves the level unsolvable.
+    bool deadlocked;
+
+    // How many more boxes than goals the level has. Deadlocks are only
+    // detected when there are none to spare.
+    int surplus;
+
+    // The map is stored row by row in a single buffer, surrounded by a
+    // border of walls so that no move ever needs a bounds check.
+    // The cell at (x, y) is found at (y + 1) * stride + x + 1.
+    int stride;
+    int player;
+    std::vector<uint8_t> map;
+};
+
+// A set of cells, one bit per cell. Each row of the level starts on a new
+// word, so the cells above and below a run of cells are whole words away.
+struct CellSet
+{
+    int words;  // Per row.
+    std::vector<uint64_t> bits;
+};
+
+// Every move made is one byte in the journal: the index of its direction
+// in the low two bits, and these flags. Undoing a move only needs its byte.
+const uint8_t PUSHED = 4;
+const uint8_t WAS_DEADLOCKED = 8;
+
+// A copy of the level state every SNAPSHOT_INTERVAL moves lets the game
+// jump to any point in the journal without replaying it from the start.
+const int SNAPSHOT_INTERVAL = 1024;
+
+struct Snapshot
+{
+    std::vector<uint8_t> map;
+    int player, goals;
+    bool deadlocked;
+};
+
+struct History
+{
+    std::vector<uint8_t> moves;
+    std::vector<Snapshot> snapshots;
+
+    // Moves before this position have been played, the rest can be redone.
+    unsigned int position;
+};
+
+// The level file, mapped into memory, and where each level's text starts
+// and ends within it. Levels are only parsed when they are asked for.
+// When an up to date compiled cache of the file exists, levels are
+// instead read from the cache and the text is not kept at all.
+struct LevelSpan
+{
+    size_t begin, end;
+};
+
+struct LevelPack
+{
+    const char* data;
+    size_t size;
+    std::vector<LevelSpan> index;
+
+    const uint8_t* compiled;
+    size_t compiledSize;
+    int count;
+    int skipped;  // Levels of the file left out because they can't be played.
+};
+
+struct SolveOptions
+{
+    bool optimizeMoves;  // Minimise moves instead of pushes.
+    long long maxNodes;  // Give up after expanding this many states, 0 for no limit.
+    int tableBits;       // The transposition table holds 2^tableBits entries.
+    const std::atomic<bool>* cancel;  // Give up once this is set, if given.
+};
+
+// Dragging a box gives up after this many flood fills, rather than
+// hold up the game on a huge maze of a level.
+const int PUSH_PATH_MAX_FLOODS = 20000;
+
+// Walks keep their scratch space, about a byte per cell, for the next
+// walk, unless the level has more cells than this.
+const size_t WALK_KEEP_CELLS = 1 << 20;
+
+// How many states the command line solvers expand before giving up,
+// unless told otherwise. The lower bound only counts pushes, so move
+// optimal searches (`--moves`) only finish on small levels, and need
+// a limit to fail in reasonable time on the others.
+const long long SOLVE_MAX_NODES = 5000000;
+
+// The benchmarks walk through the levels at random with benchMove,
+// playing this many moves on a level before going on to the next.
+const int BENCH_LEVEL_MOVES = 200;
+
+struct SolveResult
+{
+    bool solved;
+    bool gaveUp;         // Stopped at maxNodes or when cancelled, so there may still be a solution.
+    std::string moves;   // LURD notation, upper case letters are pushes.
+    int pushes;
+    long long nodes;
+    double seconds;
+    size_t memory;       // Bytes held by the search at its peak.
+};
+
+struct GenerateOptions
+{
+    int width, height;  // Of each room, counting its outer walls.
+    int boxes;
+    int candidates;     // Rooms tried for each level, the best is kept.
+    uint64_t seed;
+};
+
+// Generated rooms are played backwards for this many steps per floor
+// cell. Candidates score their pushes, plus this much for each time
+// the solution turns to a different box, and are passed over if they
+// take the solver more than GENERATE_MAX_NODES states.
+const int GENERATE_PULL_STEPS = 8;
+const int GENERATE_CHANGE_WEIGHT = 3;
+const long long GENERATE_MAX_NODES = 200000;
+
+// Sessions are recorded as text. Each level played starts with a
+// "level N" line, followed by what was done in LURD notation, upper case
+// for pushes, with '-' for an undo and '*' for a restart, wrapped every
+// REPLAY_COLUMNS characters. "end" and a hash of the level state close
+// it. Replays are written and read a line at a time.
+const char REPLAY_MAGIC[] = "DIVERGENCE REPLAY 1";
+const int REPLAY_COLUMNS = 72;
+
+// What playAction returns for a restart.
+const int RESTARTED = 0x100;
+
+struct Recording
+{
+    FILE* file;
+    int column;
+};
+
+// Function prototypes.
+bool initLevels();
+bool indexLevels(const char*, LevelPack&);
+bool checkLevels(LevelPack&, const char*);
+bool compileLevels(const LevelPack&, const char*);
+Level parseLevel(const char*, const char*);
+Level readLevel(const LevelPack&, int);
+const char* levelError(const Level&);
+std::string levelText(const Level&);
+int play(int, Level&, History&);
+int applyMove(int, Level&);
+int move(int, int, const Level&);
+bool moveBox(int, int, Level&);
+void startHistory(History&, const Level&);
+int takeBack(Level&, History&);
+int playAgain(Level&, History&);
+void seek(Level&, History&, unsigned int);
+int benchMove(Level&, History&, uint64_t&, bool&);
+void initCellSet(CellSet&, const Level&);
+bool hasCell(const CellSet&, const Level&, int);
+void setCell(CellSet&, const Level&, int, bool);
+void openCells(const Level&, CellSet&);
+void flood(const CellSet&, const Level&, int, CellSet&);
+bool findWalk(const Level&, int, int, std::string&);
+bool findPushPath(const Level&, int, int, std::string&);
+void findDeadSquares(Level&);
+bool freezeDeadlock(Level&, int);
+SolveResult solve(const Level&, const SolveOptions&);
+int solveFromCommandLine(int, const SolveOptions&);
+int verifyAll(int, const SolveOptions&);
+int generateLevels(int, const char*, int, const GenerateOptions&);
+uint64_t canonicalHash(const Level&);
+int dedupeLevels(const char*, const char*);
+bool startRecording(const char*);
+void recordLevel(int);
+void recordAction(char);
+void recordEnd(const Level&);
+char moveChar(int);
+uint64_t hashLevel(const Level&);
+int playAction(char, Level&, History&);
+
+extern LevelPack levels;
+
+// Where the session is being recorded, if anywhere.
+extern Recording recording;
+
+#endif
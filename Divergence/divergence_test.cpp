@@ -0,0 +1,283 @@
+/*
+ * Divergence (a Sokoban (or Sokouban if you're a purist) clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "divergence_core.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// A room with space to wander, so a long walk keeps moving boxes.
+const char ROOM[] =
+    "##########\n"
+    "#@   .   #\n"
+    "#  $   $ #\n"
+    "#   ##   #\n"
+    "# .  $ . #\n"
+    "#  $     #\n"
+    "#   .    #\n"
+    "##########\n";
+
+// Function prototypes.
+bool check(bool, const char*);
+Level levelFrom(const std::string&);
+bool writeFile(const char*, const std::string&);
+std::string turned(const std::string&);
+std::string mirrored(const std::string&);
+int testHistory();
+int testUnplayable();
+int testGiveUp();
+int testCache();
+int testDedupe();
+
+int main()
+{
+    // Checks of the Divergence core that the benchmarks don't make.
+    // Returns 1 if any of them fail.
+    int result = 0;
+    result |= testHistory();
+    result |= testUnplayable();
+    result |= testGiveUp();
+    result |= testCache();
+    result |= testDedupe();
+
+    printf(result ? "Some checks failed.\n" : "All checks passed.\n");
+    return result;
+}
+
+bool check(bool passed, const char* what)
+{
+    if(!passed) printf("FAILED: %s\n", what);
+    return passed;
+}
+
+Level levelFrom(const std::string &text)
+{
+    return parseLevel(text.data(), text.data() + text.size());
+}
+
+bool writeFile(const char* path, const std::string &text)
+{
+    FILE* file = fopen(path, "w");
+    if(!file) return false;
+
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && written;
+}
+
+std::string turned(const std::string &text)
+{
+    // The level turned a quarter turn clockwise.
+    std::vector<std::string> rows;
+    size_t width = 0;
+    for(size_t at = 0; at < text.size();)
+    {
+        size_t end = text.find('\n', at);
+        rows.push_back(text.substr(at, end - at));
+        width = std::max(width, rows.back().size());
+        at = end + 1;
+    }
+
+    std::string out;
+    for(size_t x = 0; x < width; x++)
+    {
+        for(size_t y = rows.size(); y-- > 0;)
+        {
+            out += x < rows[y].size() ? rows[y][x] : ' ';
+        }
+        out += '\n';
+    }
+
+    return out;
+}
+
+std::string mirrored(const std::string &text)
+{
+    // The level flipped left to right.
+    std::string out;
+    for(size_t at = 0; at < text.size();)
+    {
+        size_t end = text.find('\n', at);
+        std::string row = text.substr(at, end - at);
+        out += std::string(row.rbegin(), row.rend()) + '\n';
+        at = end + 1;
+    }
+
+    return out;
+}
+
+int testHistory()
+{
+    // Play a long random walk, then check that seeking to any point of
+    // the journal, and taking moves back and playing them again, give
+    // the same level as playing the moves from the start.
+    Level start = levelFrom(ROOM);
+    Level level = start;
+    History history;
+    startHistory(history, level);
+
+    uint64_t rng = 1;
+    bool undone;
+    for(int i = 0; i < 5 * SNAPSHOT_INTERVAL; i++)
+    {
+        benchMove(level, history, rng, undone);
+    }
+
+    bool passed = check(history.moves.size() > 2 * SNAPSHOT_INTERVAL, "the walk is long enough to pass snapshots");
+
+    std::vector<uint64_t> hashes;
+    Level replayed = start;
+    hashes.push_back(hashLevel(replayed));
+    for(unsigned int i = 0; i < history.moves.size(); i++)
+    {
+        passed &= check(applyMove(DIRECTIONS[history.moves[i] & 3], replayed) >= 0, "the journal plays back");
+        hashes.push_back(hashLevel(replayed));
+    }
+    passed &= check(hashes.back() == hashLevel(level), "the journal ends where the walk did");
+
+    for(int i = 0; i < 200; i++)
+    {
+        unsigned int position = splitmix64(rng) % (history.moves.size() + 1);
+        seek(level, history, position);
+        passed &= check(hashLevel(level) == hashes[position], "seeking gives the level at that point");
+    }
+
+    seek(level, history, history.moves.size());
+    for(unsigned int i = history.moves.size(); i > 0; i--)
+    {
+        passed &= check(takeBack(level, history) >= 0 && hashLevel(level) == hashes[i - 1], "taking a move back undoes it");
+    }
+    passed &= check(takeBack(level, history) == -1, "there is nothing to take back at the start");
+
+    for(unsigned int i = 1; i <= history.moves.size(); i++)
+    {
+        passed &= check(playAgain(level, history) >= 0 && hashLevel(level) == hashes[i], "playing a move again redoes it");
+    }
+    passed &= check(playAgain(level, history) == -1, "there is nothing to play again at the end");
+
+    return passed ? 0 : 1;
+}
+
+int testUnplayable()
+{
+    // Levels without exactly one player, or with nothing in them, can't
+    // be played or solved.
+    std::string room = ROOM;
+    std::string noPlayer = room, twoPlayers = room;
+    noPlayer[room.find('@')] = ' ';
+    twoPlayers[room.find("   .")] = '@';
+
+    bool passed = check(levelError(levelFrom(room)) == nullptr, "a good level can be played");
+    passed &= check(levelError(levelFrom(noPlayer)) != nullptr, "a level without a player can't be played");
+    passed &= check(levelError(levelFrom(twoPlayers)) != nullptr, "a level with two players can't be played");
+    passed &= check(levelError(levelFrom("")) != nullptr, "an empty level can't be played");
+
+    SolveResult result = solve(levelFrom(noPlayer), SolveOptions{false, 1000, 16, nullptr});
+    passed &= check(!result.solved && result.nodes == 0, "a level without a player isn't searched");
+
+    return passed ? 0 : 1;
+}
+
+int testGiveUp()
+{
+    // A search stopped by its limit says it gave up, which isn't the
+    // same as finding that there is no solution.
+    SolveResult result = solve(levelFrom(ROOM), SolveOptions{false, 10, 16, nullptr});
+    bool passed = check(!result.solved && result.gaveUp, "a search that hits its limit gives up");
+
+    result = solve(levelFrom("######\n#@ .$#\n######\n"), SolveOptions{false, 1000, 16, nullptr});
+    passed &= check(!result.solved && !result.gaveUp, "a level without a solution is searched to the end");
+
+    result = solve(levelFrom(ROOM), SolveOptions{false, SOLVE_MAX_NODES, 20, nullptr});
+    passed &= check(result.solved && !result.gaveUp, "the room can be solved");
+
+    return passed ? 0 : 1;
+}
+
+int testCache()
+{
+    // levels.bin must be rebuilt when levels changes, and used when it
+    // hasn't. Unplayable levels are left out of both.
+    char dir[] = "/tmp/divergence_test_XXXXXX";
+    char* cwd = getcwd(nullptr, 0);
+    if(!check(mkdtemp(dir) && chdir(dir) == 0, "a scratch directory can be made")) return 1;
+
+    std::string room = ROOM;
+    std::string noPlayer = room;
+    noPlayer[room.find('@')] = ' ';
+
+    bool passed = check(writeFile("levels", room + ",\n"), "the level file can be written");
+
+    levels = LevelPack{nullptr, 0, {}, nullptr, 0, 0, 0};
+    passed &= check(initLevels() && levels.count == 1 && levels.compiled == nullptr, "the cache is built from a new file");
+
+    levels = LevelPack{nullptr, 0, {}, nullptr, 0, 0, 0};
+    passed &= check(initLevels() && levels.count == 1 && levels.compiled != nullptr, "an up to date cache is used");
+
+    passed &= check(writeFile("levels", room + ",\n" + noPlayer + ",\n" + mirrored(room) + ",\n"), "the level file can be changed");
+
+    levels = LevelPack{nullptr, 0, {}, nullptr, 0, 0, 0};
+    passed &= check(initLevels() && levels.compiled == nullptr, "the cache is rebuilt when the file changes");
+    passed &= check(levels.count == 2 && levels.skipped == 1, "an unplayable level is left out");
+    passed &= check(hashLevel(readLevel(levels, 1)) == hashLevel(levelFrom(mirrored(room))), "the levels after it move up");
+
+    levels = LevelPack{nullptr, 0, {}, nullptr, 0, 0, 0};
+    passed &= check(initLevels() && levels.compiled != nullptr && levels.count == 2 && levels.skipped == 1,
+        "the rebuilt cache is used, and remembers what was left out");
+
+    remove("levels");
+    remove("levels.bin");
+    passed &= check(chdir(cwd) == 0 && rmdir(dir) == 0, "the scratch directory can be removed");
+    free(cwd);
+
+    return passed ? 0 : 1;
+}
+
+int testDedupe()
+{
+    // Turned and mirrored copies of a level are duplicates. Another
+    // level isn't, and an unplayable one is left out.
+    std::string room = ROOM;
+    std::string other = room, noPlayer = room;
+    other[room.find("$ #")] = ' ';
+    other[room.find(" .  $")] = '$';
+    noPlayer[room.find('@')] = ' ';
+
+    std::string in = "/tmp/divergence_test_in.txt", out = "/tmp/divergence_test_out.txt";
+    bool passed = check(writeFile(in.c_str(), room + ",\n" + turned(room) + ",\n" + mirrored(turned(room)) + ",\n"
+        + other + ",\n" + noPlayer + ",\n" + turned(turned(room)) + ",\n"), "the level file can be written");
+
+    passed &= check(dedupeLevels(in.c_str(), out.c_str()) == 0, "dedupe runs");
+
+    LevelPack pack{nullptr, 0, {}, nullptr, 0, 0, 0};
+    passed &= check(indexLevels(out.c_str(), pack) && pack.count == 2, "only the two different levels are kept");
+    if(pack.count == 2)
+    {
+        passed &= check(hashLevel(readLevel(pack, 0)) == hashLevel(levelFrom(room)), "the first copy is kept");
+        passed &= check(canonicalHash(readLevel(pack, 1)) == canonicalHash(levelFrom(other)), "the other level is kept");
+    }
+
+    remove(in.c_str());
+    remove(out.c_str());
+
+    return passed ? 0 : 1;
+}
@@ -16,120 +16,272 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
-#include <SDL.h>
+#include "slither_core.h"
+#include "engine.h"
 
 #include <cstdlib>
-#include <vector>
-#include <iostream>
 #include <ctime>
+#include <algorithm>
+#include <vector>
+#include <thread>
 
 #include <string.h>
 #include <stdio.h>
 
-struct Point
-{
-    int x, y;
-};
-
-// Function prototypes.
-bool init();
-void update();
-void render();
-
-const int B_WIDTH = 20;
-const int B_HEIGHT = 20;
-
 const int DELAY = (int) 1000 / 10;
 
-const int LEFT = SDL_SCANCODE_LEFT;
-const int UP = SDL_SCANCODE_UP;
-const int RIGHT = SDL_SCANCODE_RIGHT;
-const int DOWN = SDL_SCANCODE_DOWN;
 const int KEY_P = SDL_SCANCODE_P;
 
-SDL_Window* window = nullptr;
-SDL_Renderer* renderer = nullptr;
+// Ticks missed over a stall longer than this, in ms, are dropped.
+const int MAX_LAG = 250;
+
+// How many turns can be pressed ahead of the snake.
+const int INPUT_QUEUE = 3;
+
+// Turns waiting for a tick, oldest first. Each tick takes one.
+struct InputQueue
+{
+    int directions[INPUT_QUEUE];
+    int count;
+};
 
-bool fullscreen = true;
+// The arrow keys are played as the directions they point, both as
+// direction values and as indexes into DIRECTIONS.
+static_assert(LEFT == ARROW_LEFT && UP == ARROW_UP && RIGHT == ARROW_RIGHT && DOWN == ARROW_DOWN,
+    "The engine numbers the arrow keys differently from the game.");
+static_assert(DIRECTIONS[ARROW_LEFT] == LEFT && DIRECTIONS[ARROW_UP] == UP
+    && DIRECTIONS[ARROW_RIGHT] == RIGHT && DIRECTIONS[ARROW_DOWN] == DOWN,
+    "DIRECTIONS must list the directions in the order the arrow keys are numbered.");
 
-int W_WIDTH = 0;
-int W_HEIGHT = 0;
+// Function prototypes.
+void render(const SlitherSim&, float);
+void drawBackground(const SlitherSim&);
+bool queueDirection(InputQueue&, int, int);
+int nextDirection(InputQueue&, int);
+bool layoutBoard(int, int);
+int benchRender(int, int, long long, uint64_t, const char*);
 
-int cellSize = 0, xp = 0, yp = 0;
+// The gray window and black board, drawn once and copied each frame.
+SDL_Texture* background = nullptr;
 
-int direction = RIGHT;
+// The body, filled in by render and drawn with one call.
+CellBatch body{{}, 0x00, 0xFF, 0x00};
 
-int length = 3;
-std::vector<Point> body;
+// Where the head and tail were before the last tick,
+// so render can draw the snake sliding between cells.
+Point lastHead{0, 0}, lastTail{0, 0};
 
-Point food{0, 0};
+SlitherSim sim;
 
 int main(int argc, char* args[])
 {
-    // Allow a `-w` flag to launch in windowed mode.
-    // Can be followed by width and height: `-w 800 600`.
-    // Defaults to 800x600.
+    // `--headless` runs the game without a window as fast as it can,
+    // for `--ticks N` ticks from `--seed S`, turning at random.
+    // With `--batch N` it steps N games at once instead, on
+    // `--threads J` threads. `--autopilot` lets the snake steer
+    // itself, and headless, plays until it fills the board.
+    // `--record FILE` saves the game as a replay, and `--replay FILE`
+    // plays one back, `--speed N` times as fast, or with 0 a tick every
+    // frame, without waiting between them. Headless, a replay
+    // is only checked, as fast as it can be, and only `--autopilot`
+    // can record.
+    // `--timing FILE` saves how long each part of a frame took, as a
+    // CSV file, or JSON if FILE ends in ".json". `--overlay` starts with
+    // the timings drawn over the game, and F3 turns that on and off.
+    // `--bench-render N` draws N frames of a game from `--seed S` into
+    // memory with the software renderer, and reports how fast it went.
+    // `--frame-sums FILE` saves a checksum of each of those frames.
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* timingPath = nullptr;
+    const char* sumsPath = nullptr;
+    long long benchFrames = 0;
+    double speed = 1;
+    bool headless = false;
+    bool autopilot = false;
+    long long ticks = 1000000;
+    int batchSize = 0;
+    int threads = std::thread::hardware_concurrency();
+    uint64_t seed = time(NULL);
+    int width = B_WIDTH, height = B_HEIGHT;
+
+    // `--tick-rate N` sets how many times a second the snake moves.
+    double tickRate = 1000.0 / DELAY;
+
     for(int i = 0; i < argc; i++)
     {
-        if(strcmp(args[i], "-w") == 0)
+        if(strcmp(args[i], "--headless") == 0)
         {
-            fullscreen = false;
-            if(i + 2 < argc)
-            {
-                W_WIDTH = atoi(args[i + 1]);
-                W_HEIGHT = atoi(args[i + 2]);
-            }
-            else
-            {
-                W_WIDTH = 800;
-                W_HEIGHT = 600;
-            }
+            headless = true;
+        }
+        else if(strcmp(args[i], "--ticks") == 0 && i + 1 < argc)
+        {
+            ticks = atoll(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoull(args[i + 1], nullptr, 10);
+        }
+        else if(strcmp(args[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batchSize = atoi(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--autopilot") == 0)
+        {
+            autopilot = true;
+        }
+        else if(strcmp(args[i], "--board") == 0 && i + 2 < argc)
+        {
+            width = atoi(args[i + 1]);
+            height = atoi(args[i + 2]);
+        }
+        else if(strcmp(args[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = args[i + 1];
+        }
+        else if(strcmp(args[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replayPath = args[i + 1];
+        }
+        else if(strcmp(args[i], "--speed") == 0 && i + 1 < argc)
+        {
+            speed = atof(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--timing") == 0 && i + 1 < argc)
+        {
+            timingPath = args[i + 1];
+        }
+        else if(strcmp(args[i], "--overlay") == 0)
+        {
+            timing.overlay = true;
+        }
+        else if(strcmp(args[i], "--tick-rate") == 0 && i + 1 < argc)
+        {
+            tickRate = atof(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--bench-render") == 0 && i + 1 < argc)
+        {
+            benchFrames = atoll(args[i + 1]);
+        }
+        else if(strcmp(args[i], "--frame-sums") == 0 && i + 1 < argc)
+        {
+            sumsPath = args[i + 1];
         }
     }
 
-    if(!init()) return 1;
+    // Allow a `-w` flag to launch in windowed mode.
+    readWindowArgs(argc, args);
 
-    if(fullscreen)
+    if(headless && replayPath) return verifyReplay(replayPath);
+
+    // A replay brings its own board and seed.
+    Replay replay{nullptr, 0, 0, 0, 0, 0, false, 0, 0};
+    if(replayPath)
     {
-        // Set the W_WIDTH and W_HEIGHT variables.
-        SDL_GL_GetDrawableSize(window, &W_WIDTH, &W_HEIGHT);
+        if(!openReplay(replay, replayPath)) return 1;
+
+        width = replay.width;
+        height = replay.height;
+        seed = replay.seed;
+        autopilot = false;
     }
 
-    // Determine cell size based on board and window dimensions.
-    // Allows the drawn board to scale to the window size.
-    cellSize = (int)std::min(W_WIDTH / B_WIDTH, W_HEIGHT / B_HEIGHT);
+    if(speed < 0)
+    {
+        printf("The replay speed can't be negative.\n");
+        return 1;
+    }
 
-    // Determine x and y padding, which are
-    // used to centre the board within the window.
-    xp = (int)((W_WIDTH - (cellSize * B_WIDTH)) / 2);
-    yp = (int)((W_HEIGHT - (cellSize * B_HEIGHT)) / 2);
+    if(width < 4 || height < 2 || width > MAX_BOARD || height > MAX_BOARD)
+    {
+        printf("The board must be from 4x2 to %dx%d cells.\n", MAX_BOARD, MAX_BOARD);
+        return 1;
+    }
 
-    // Fill the window surface with gray.
-    SDL_SetRenderDrawColor(renderer, 0x88, 0x88, 0x88, 0xFF);
-    SDL_RenderClear(renderer);
+    if(benchFrames > 0) return benchRender(width, height, benchFrames, seed, sumsPath);
+    if(headless && recordPath && (batchSize > 0 || !autopilot))
+    {
+        printf("Without a window, only a single autopilot game can be recorded.\n");
+        return 1;
+    }
+    if(headless && batchSize > 0) return runBatch(batchSize, width, height, ticks, seed, std::max(threads, 1));
+    if(headless && autopilot) return runAutopilot(width, height, ticks, seed, recordPath);
+    if(headless) return runHeadless(width, height, ticks, seed);
 
-    // Seed the (pseudo)random number generator.
-    srand(time(NULL));
+    if(!initWindow("Slither")) return 1;
 
-    // Initialize the snake body.
-    for(int k = 0; k < length; k++)
+    if(!layoutBoard(width, height))
     {
-        body.push_back(Point{(int)B_WIDTH / 2 - k, (int)B_HEIGHT / 2});
+        closeWindow();
+        return 1;
     }
 
-    // Initialize the food location.
-    food.x = (int)(rand() % B_WIDTH);
-    food.y = (int)(rand() % B_HEIGHT);
+    // A tick can be no shorter than a performance counter unit.
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    if(tickRate <= 0) tickRate = 1000.0 / DELAY;
+    if(replay.file && speed > 0) tickRate *= speed;
+    if(tickRate > frequency)
+    {
+        printf("The game can tick at most %llu times a second.\n", (unsigned long long) frequency);
+        closeWindow();
+        return 1;
+    }
+
+    // Start a new game.
+    initSim(sim, width, height, seed);
+    body.rects.reserve(width * height + 1);
+    lastHead = segment(sim, 0);
+    lastTail = segment(sim, sim.length - 1);
+
+    Autopilot pilot;
+    if(autopilot && !initAutopilot(pilot, sim))
+    {
+        closeWindow();
+        return 1;
+    }
+
+    Recording recording{nullptr, 0, 0, 0};
+    if(recordPath && !startRecording(recording, recordPath, sim, seed))
+    {
+        closeWindow();
+        return 1;
+    }
+
+    long long played = 0;
+
+    // The game ticks at a fixed rate, however fast frames are drawn.
+    // Time since the last tick builds up in lag, in performance
+    // counter units, and is spent a tick at a time.
+    Uint64 tickLength = frequency / tickRate;
+    Uint64 lag = 0;
+    Uint64 previous = SDL_GetPerformanceCounter();
+
+    InputQueue input{{}, 0};
 
     bool paused = false;
 
+    // A frame is only drawn when it would look different from the last
+    // one: after a tick, when the snake has slid another pixel, or when
+    // the window needs it. In between, the loop sleeps in SDL_WaitEvent
+    // until the next of those or an event, and while paused it sleeps
+    // until an event.
+    bool redraw = true;
+    Uint64 drawnSlide = 0;
+    int waitMs = 0;
+
     // Main game loop.
     bool running = true;
     while(running)
     {
         // Handle events.
         SDL_Event event;
-        while(SDL_PollEvent(&event))
+        int pending = waitMs < 0 ? SDL_WaitEvent(&event) :
+            waitMs > 0 ? SDL_WaitEventTimeout(&event, waitMs) : pollEvent(&event);
+        for(; pending; pending = pollEvent(&event))
         {
             switch(event.type)
             {
@@ -137,6 +289,17 @@ int main(int argc, char* args[])
                     running = false;
                     break;
 
+                case SDL_WINDOWEVENT:
+                    redraw = true;
+                    break;
+
+                case SDL_RENDER_TARGETS_RESET:
+                    // The background lost its contents, make it again.
+                    if(background) SDL_DestroyTexture(background);
+                    background = nullptr;
+                    redraw = true;
+                    break;
+
                 case SDL_KEYDOWN:
 
                     switch((int) event.key.keysym.scancode)
@@ -145,196 +308,305 @@ int main(int argc, char* args[])
                             running = false;
                             break;
 
-                        case LEFT:
-                        case UP:
-                        case RIGHT:
-                        case DOWN:
-                            direction = event.key.keysym.scancode;
+                        case SDL_SCANCODE_LEFT:
+                        case SDL_SCANCODE_UP:
+                        case SDL_SCANCODE_RIGHT:
+                        case SDL_SCANCODE_DOWN:
+                            if(event.key.repeat == 0)
+                            {
+                                queueDirection(input, arrowDirection(event.key.keysym.scancode), sim.direction);
+                            }
                             break;
 
                         case KEY_P:
                             paused = !paused;
+                            break;
+
+                        case SDL_SCANCODE_F3:
+                            timing.overlay = !timing.overlay;
+                            redraw = true;
                     }
             }
         }
 
-        if(paused) continue;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if(!paused) lag += now - previous;
+        previous = now;
 
-        // Change game state.
-        update();
+        // After a long stall, such as the window being dragged,
+        // drop the ticks that were missed rather than racing through them.
+        // Frames never get this long otherwise, so fast games still play
+        // as many ticks a frame as they need to keep up.
+        if(lag > frequency * MAX_LAG / 1000 && lag > tickLength) lag = tickLength;
 
-        // Render the new state.
-        render();
+        // A replay at speed 0 plays a tick every frame.
+        bool everyFrame = replay.file && speed == 0 && !paused;
+        if(everyFrame) lag = tickLength;
 
-        // Wait for DELAY milliseconds before continuing.
-        // Controls how fast the snake moves.
-        SDL_Delay(DELAY);
-    }
+        while(lag >= tickLength)
+        {
+            redraw = true;
 
-    // Destroy the renderer, window, and quit SDL.
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+            lastHead = segment(sim, 0);
+            lastTail = segment(sim, sim.length - 1);
 
-    return 0;
-}
+            // A replay steers until it runs out, then the game
+            // pauses there, and the keyboard takes over.
+            if(replay.file && !replayTick(replay, sim.direction))
+            {
+                checkReplay(replay, sim, played);
+                fclose(replay.file);
+                replay.file = nullptr;
+                paused = true;
+                lag = 0;
+                break;
+            }
 
-bool init()
-{
-    // Initialize SDL.
-    if(SDL_Init(SDL_INIT_VIDEO) < 0)
-    {
-        printf("SDL could not initialise! SDL_Error: %s\n", SDL_GetError());
-    }
-    else
-    {
-        // Create window.
-        int flags = SDL_WINDOW_SHOWN;
-        if(fullscreen)
+            // Change game state.
+            if(!replay.file)
+            {
+                sim.direction = autopilot ? steer(pilot, sim) : nextDirection(input, sim.direction);
+            }
+            if(recording.file) recordTick(recording, sim.direction);
+
+            Uint64 start = startTiming();
+            update(sim);
+            endTiming(PHASE_UPDATE, start);
+            played++;
+
+            lag -= tickLength;
+        }
+
+        // How many pixels the snake has slid into its next cell.
+        Uint64 slide = lag * cellSize / tickLength;
+        if(redraw || slide != drawnSlide)
         {
-            flags |= SDL_WINDOW_FULLSCREEN;
+            // Render the state, part way to the next tick.
+            // Presenting waits for vsync, which paces the loop.
+            render(sim, (float) lag / tickLength);
+            drawnSlide = slide;
+            redraw = false;
         }
 
-        window = SDL_CreateWindow("Slither", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, W_WIDTH, W_HEIGHT, flags);
-        if(window == NULL)
+        // Sleep until the snake slides another pixel, or for good when paused.
+        if(paused)
         {
-            printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
-            
-            SDL_Quit();
+            waitMs = -1;
+        }
+        else if(everyFrame)
+        {
+            waitMs = 0;
         }
         else
         {
-            // Set the renderer, which will be used as
-            // the base for all drawing operations.
-            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-            if(renderer == NULL)
-            {
-                printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
-
-                SDL_DestroyWindow(window);
-                SDL_Quit();
-            }
-            else
-            {
-                return true;
-            }
+            // Round up, so less than a millisecond still sleeps rather
+            // than spinning on pollEvent until the pixel is due.
+            Uint64 until = ((slide + 1) * tickLength + cellSize - 1) / cellSize - lag;
+            waitMs = (until * 1000 + frequency - 1) / frequency;
         }
     }
 
-    return false;
+    if(autopilot) reportAutopilot(pilot);
+    if(recording.file) finishRecording(recording, sim);
+    if(replay.file) fclose(replay.file);
+
+    if(timingPath)
+    {
+        printTiming();
+        dumpTiming(timingPath);
+    }
+
+    // Destroy the texture, renderer, window, and quit SDL.
+    if(background) SDL_DestroyTexture(background);
+    closeWindow();
+
+    return 0;
 }
 
-void update()
+bool layoutBoard(int width, int height)
 {
-    // Move the snake.
-    int nx = body[0].x, ny = body[0].y;
-    switch(direction)
+    // Scale the board to the window. Cells are drawn with a
+    // one pixel gap, so they need at least two pixels.
+    layoutGrid(width, height, 0);
+    if(cellSize < 2)
     {
-        case LEFT:
-            nx = body[0].x - 1;
-            break;
+        printf("A %dx%d board doesn't fit in the window.\n", width, height);
+        return false;
+    }
 
-        case UP:
-            ny = body[0].y - 1;
-            break;
+    return true;
+}
 
-        case RIGHT:
-            nx = body[0].x + 1;
-            break;
+bool queueDirection(InputQueue &input, int direction, int current)
+{
+    // Queue a turn, unless it doesn't change the direction the snake
+    // will be going by then, or would turn it back into itself.
+    int last = input.count > 0 ? input.directions[input.count - 1] : current;
+    if(input.count == INPUT_QUEUE || direction == last || direction == opposite(last))
+    {
+        return false;
+    }
+
+    input.directions[input.count++] = direction;
+    return true;
+}
+
+int nextDirection(InputQueue &input, int current)
+{
+    // Take the oldest queued turn, if there is one.
+    if(input.count == 0) return current;
+
+    int direction = input.directions[0];
+    input.count--;
+    memmove(input.directions, input.directions + 1, input.count * sizeof(int));
+    return direction;
+}
 
-        case DOWN:
-            ny = body[0].y + 1;
-            break;
+void render(const SlitherSim &sim, float t)
+{
+    // Do rendering. t is how far it is from the last tick
+    // to the next one, from 0 to 1. The head is drawn that
+    // far into its cell, and the tail that far out of its
+    // old one. Moves that wrap around the board aren't slid.
+    // Each colour is drawn with one call, however long the snake.
+    Uint64 start = startTiming();
+
+    if(!background && SDL_RenderTargetSupported(renderer))
+    {
+        background = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, W_WIDTH, W_HEIGHT);
+        if(background)
+        {
+            SDL_SetRenderTarget(renderer, background);
+            drawBackground(sim);
+            SDL_SetRenderTarget(renderer, nullptr);
+        }
     }
 
-    // If the snake tries to go off the edge
-    // of the board, wrap it around.
-    if(nx >= B_WIDTH)
+    if(background)
     {
-        nx -= B_WIDTH;
+        copyTexture(background, nullptr, nullptr);
     }
-    else if(nx < 0)
+    else
     {
-        nx += B_WIDTH;
+        drawBackground(sim);
     }
-    else if(ny >= B_HEIGHT)
+
+    // Draw the body, in light green, behind the head.
+    for(int i = 1; i < sim.length; i++)
     {
-        ny -= B_HEIGHT;
+        const Point &p = segment(sim, i);
+        body.rects.push_back(gridCell(p.x, p.y));
     }
-    else if(ny < 0)
+
+    // Along with the tail leaving the cell it was in.
+    const Point &tail = segment(sim, sim.length - 1);
+    if(abs(tail.x - lastTail.x) + abs(tail.y - lastTail.y) == 1)
     {
-        ny += B_HEIGHT;
+        body.rects.push_back(gridCell(lastTail.x + (tail.x - lastTail.x) * t, lastTail.y + (tail.y - lastTail.y) * t));
     }
 
-    // Move the snake by adding a new head.
-    body.insert(body.begin(), Point{nx, ny});
+    drawBatch(body);
 
-    // Check if the snake is eating food.
-    if(body[0].x == food.x && body[0].y == food.y)
+    // Draw the snake's head, in dark green, entering its cell.
+    const Point &h = sim.body[sim.head];
+    float hx = h.x, hy = h.y;
+    if(abs(h.x - lastHead.x) + abs(h.y - lastHead.y) == 1)
     {
-        // Increment length.
-        length++;
-
-        // Set food to a random location within the board's dimensions.
-        food.x = (int)(rand() % B_WIDTH);
-        food.y = (int)(rand() % B_HEIGHT);
+        hx = lastHead.x + (h.x - lastHead.x) * t;
+        hy = lastHead.y + (h.y - lastHead.y) * t;
     }
-    else
+    SDL_Rect r = gridCell(hx, hy);
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x88, 0x00, 0xFF);
+    fillRect(&r);
+
+    // Draw the food.
+    if(sim.food.x >= 0)
     {
-        // If the snake hasn't eaten, remove the tail.
-        body.pop_back();
+        r = gridCell(sim.food.x, sim.food.y);
+        SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, 0xFF);
+        fillRect(&r);
     }
 
-    // Check if the snake is eating itself.
-    // Start with the third part, since the
-    // snake cannot eat any part before that.
-    for(int i = 2; i < body.size(); i++)
-    {
-        if(body[0].x == body[i].x && body[0].y == body[i].y)
-        {
-            // Set length to 3 and trim body.
-            length = 3;
-            while(body.size() > length)
-            {
-                body.pop_back();
-            }
+    endTiming(PHASE_RENDER, start);
 
-            break;
-        }
-    }
+    // Update the window with the rendering performed.
+    present();
 }
 
-void render()
+void drawBackground(const SlitherSim &sim)
 {
-    // Do rendering.
-
     // Fill the window surface with gray.
     SDL_SetRenderDrawColor(renderer, 0x88, 0x88, 0x88, 0xFF);
-    SDL_RenderClear(renderer);
+    clearTarget();
 
     // Fill the board with black.
-    SDL_Rect r{xp, yp, cellSize * B_WIDTH, cellSize * B_HEIGHT};
+    SDL_Rect r{xp, yp, cellSize * sim.width, cellSize * sim.height};
     SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
-    SDL_RenderFillRect(renderer, &r);
-
-    // Draw the snake's head, in dark green.
-    r = {body[0].x * cellSize + xp, body[0].y * cellSize + yp, cellSize - 1, cellSize - 1};
-    SDL_SetRenderDrawColor(renderer, 0x00, 0x88, 0x00, 0xFF);
-    SDL_RenderFillRect(renderer, &r);
+    fillRect(&r);
+}
 
-    // Draw the rest of the body, in light green.
-    SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0x00, 0xFF);
-    for(int i = 1; i < body.size(); i++)
+int benchRender(int width, int height, long long frames, uint64_t seed, const char* sumsPath)
+{
+    // Draw a game from seed into memory, turning at random as
+    // runHeadless does. Each tick is drawn at four points of its
+    // slide, like the window draws it. Only drawing is timed.
+    if(!initOffscreen()) return 1;
+
+    int result = 1;
+    FILE* sums = nullptr;
+    if(sumsPath && (sums = fopen(sumsPath, "w")) == NULL)
     {
-        r = {body[i].x * cellSize + xp, body[i].y * cellSize + yp, cellSize - 1, cellSize - 1};
-        SDL_RenderFillRect(renderer, &r);
+        printf("Couldn't open %s for writing.\n", sumsPath);
     }
+    else if(layoutBoard(width, height))
+    {
+        initSim(sim, width, height, seed);
+        body.rects.reserve(width * height + 1);
+        lastHead = segment(sim, 0);
+        lastTail = segment(sim, sim.length - 1);
+        uint64_t input = seed ^ 0xD1B54A32D192ED03ULL;
+
+        // All the frame checksums, hashed together.
+        uint64_t all = FNV_OFFSET;
+
+        Uint64 spent = 0;
+        drawCalls = 0;
+        for(long long f = 0; f < frames; f++)
+        {
+            if(f % 4 == 0)
+            {
+                lastHead = segment(sim, 0);
+                lastTail = segment(sim, sim.length - 1);
 
-    // Draw the food.
-    r = {food.x * cellSize + xp, food.y * cellSize + yp, cellSize - 1, cellSize - 1};
-    SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, 0xFF);
-    SDL_RenderFillRect(renderer, &r);
+                uint32_t r = nextRandom(input, 32);
+                if(r < 4) sim.direction = DIRECTIONS[r];
+                update(sim);
+            }
 
-    // Update the window with the rendering performed.
-    SDL_RenderPresent(renderer);
+            Uint64 start = SDL_GetPerformanceCounter();
+            render(sim, (f % 4) / 4.0f);
+            spent += SDL_GetPerformanceCounter() - start;
+
+            if(sums)
+            {
+                uint64_t sum = frameChecksum();
+                fprintf(sums, "%lld %016llx\n", f, (unsigned long long) sum);
+                all = fnvMix(all, sum);
+            }
+        }
+        double seconds = (double) spent / SDL_GetPerformanceFrequency();
+
+        printf("%lld frames of a %dx%d board at %dx%d in %.3fs (%.0f frames/s), seed %llu.\n", frames, width, height,
+            W_WIDTH, W_HEIGHT, seconds, frames / std::max(seconds, 1e-9), (unsigned long long) seed);
+        printf("%.1f draw calls a frame.\n", (double) drawCalls / frames);
+        if(sums) printf("Frame checksums saved to %s, all frames %016llx.\n", sumsPath, (unsigned long long) all);
+        result = 0;
+    }
+
+    if(sums) fclose(sums);
+    if(background) SDL_DestroyTexture(background);
+    closeWindow();
+
+    return result;
 }
+
@@ -0,0 +1,51 @@
+/*
+ * Slither (a Snake clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "slither_core.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+int main(int argc, char* args[])
+{
+    // Simulation benchmarks of the Slither core, with fixed seeds so runs
+    // can be compared: one game on a compiled and on a run-time board
+    // size, a batch of games, and the autopilot filling a board.
+    long long ticks = argc > 1 ? atoll(args[1]) : 1000000;
+    if(ticks <= 0)
+    {
+        printf("Usage: slither_bench [ticks]\n");
+        return 1;
+    }
+
+    int threads = std::max((int) std::thread::hardware_concurrency(), 1);
+    int result = 0;
+
+    printf("Compiled board size:\n");
+    result |= runHeadless(20, 20, ticks, 1);
+    printf("Run-time board size:\n");
+    result |= runHeadless(21, 10, ticks, 1);
+    printf("Batch:\n");
+    result |= runBatch(1024, 20, 20, ticks / 1024 + 1, 1, threads);
+    printf("Autopilot:\n");
+    result |= runAutopilot(20, 20, ticks, 1, nullptr);
+
+    return result;
+}
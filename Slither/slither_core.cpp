@@ -0,0 +1,924 @@
+/*
+ * Slither (a Snake clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "slither_core.h"
+
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+#include <string.h>
+
+// A board size known when compiling. The rules compiled for it index
+// cells with constants, and wrap around power of two sizes with a mask.
+template<int W, int H>
+struct FixedBoard
+{
+    FixedBoard(int, int) {}
+    int width() const { return W; }
+    int height() const { return H; }
+};
+
+// A board size only known at run time.
+struct AnyBoard
+{
+    int w, h;
+
+    AnyBoard(int w, int h) : w(w), h(h) {}
+    int width() const { return w; }
+    int height() const { return h; }
+};
+
+// Function prototypes.
+template<class Run> int onBoard(int, int, Run);
+template<class Board> int tick(const SnakeRef&);
+template<class Board> void resetSnake(const Board&, const SnakeRef&, uint64_t);
+template<class Board> int tick(const Board&, const SnakeRef&);
+template<class Board> void addHead(const Board&, const SnakeRef&, const Point&);
+template<class Board> void removeTail(const Board&, const SnakeRef&);
+template<class Board> void placeFood(const Board&, const SnakeRef&);
+template<class Board> int runHeadless(const Board&, long long, uint64_t);
+template<class Board> void stepGames(SlitherBatch&, int, int);
+
+template<class Run>
+int onBoard(int width, int height, Run run)
+{
+    // Call run with the board compiled for this size, if there is
+    // one, or else with a board that checks its size at run time.
+    if(width == height)
+    {
+        switch(width)
+        {
+            case 16: return run(FixedBoard<16, 16>(width, height));
+            case 20: return run(FixedBoard<20, 20>(width, height));
+            case 32: return run(FixedBoard<32, 32>(width, height));
+            case 64: return run(FixedBoard<64, 64>(width, height));
+        }
+    }
+
+    return run(AnyBoard(width, height));
+}
+
+void initSim(SlitherSim &sim, int width, int height, uint64_t seed)
+{
+    int cells = width * height;
+    sim.width = width;
+    sim.height = height;
+    sim.body.resize(cells + 1);
+    sim.occupied.resize(cells);
+    sim.freeCells.resize(cells);
+    sim.freeIndex.resize(cells);
+
+    onBoard(width, height, [&sim, seed](auto board)
+    {
+        sim.tick = &tick<decltype(board)>;
+        resetSnake(board, snake(sim), seed);
+        return 0;
+    });
+}
+
+SnakeRef snake(SlitherSim &sim)
+{
+    return SnakeRef{sim.width, sim.height, &sim.direction, &sim.length, &sim.head, sim.body.data(),
+        sim.occupied.data(), sim.freeCells.data(), sim.freeIndex.data(), &sim.freeCount, &sim.food, &sim.rng};
+}
+
+int update(SlitherSim &sim)
+{
+    return sim.tick(snake(sim));
+}
+
+template<class Board>
+int tick(const SnakeRef &s)
+{
+    return tick(Board(s.width, s.height), s);
+}
+
+template<class Board>
+void resetSnake(const Board &board, const SnakeRef &s, uint64_t seed)
+{
+    // Start a new game.
+    int cells = board.width() * board.height();
+    *s.direction = RIGHT;
+    *s.length = 0;
+    *s.head = 0;
+    *s.rng = seed;
+
+    // Every cell starts out free.
+    memset(s.occupied, 0, cells);
+    for(int i = 0; i < cells; i++)
+    {
+        s.freeCells[i] = s.freeIndex[i] = i;
+    }
+    *s.freeCount = cells;
+
+    // Initialize the snake body, adding the tail first.
+    for(int k = 2; k >= 0; k--)
+    {
+        addHead(board, s, Point{board.width() / 2 - k, board.height() / 2});
+    }
+
+    // Initialize the food location.
+    placeFood(board, s);
+}
+
+template<class Board>
+int tick(const Board &board, const SnakeRef &s)
+{
+    // Move the snake.
+    const Point &h = s.body[*s.head];
+    int nx = h.x, ny = h.y;
+    switch(*s.direction)
+    {
+        case LEFT:
+            nx = h.x - 1;
+            break;
+
+        case UP:
+            ny = h.y - 1;
+            break;
+
+        case RIGHT:
+            nx = h.x + 1;
+            break;
+
+        case DOWN:
+            ny = h.y + 1;
+            break;
+    }
+
+    // If the snake tries to go off the edge
+    // of the board, wrap it around.
+    nx = wrap(nx, board.width());
+    ny = wrap(ny, board.height());
+
+    // Check if the snake is eating food.
+    bool eating = nx == s.food->x && ny == s.food->y;
+    if(!eating)
+    {
+        // If the snake hasn't eaten, remove the tail.
+        // It's gone before the head arrives, so the
+        // head may move into the cell it leaves.
+        removeTail(board, s);
+    }
+
+    // Check if the snake is eating itself, which is
+    // the case if the new head lands on its body.
+    bool biting = s.occupied[ny * board.width() + nx] > 0;
+
+    // Move the snake by adding a new head.
+    addHead(board, s, Point{nx, ny});
+
+    if(biting)
+    {
+        // Trim the body to 3 segments. Every removed
+        // segment was added once, so this is amortized O(1).
+        while(*s.length > 3)
+        {
+            removeTail(board, s);
+        }
+    }
+
+    // Set food to a random free cell, now that the snake has moved.
+    // If the board was full there was no food, so try again.
+    if(eating || s.food->x < 0) placeFood(board, s);
+
+    if(biting) return BIT;
+    return eating ? ATE : MOVED;
+}
+
+int wrap(int v, int size)
+{
+    // Bring a coordinate at most one step off the board back onto it.
+    // For a power of two size known when compiling, this is one mask.
+    if((size & (size - 1)) == 0) return v & (size - 1);
+
+    if(v < 0) return v + size;
+    if(v >= size) return v - size;
+    return v;
+}
+
+template<class Board>
+void addHead(const Board &board, const SnakeRef &s, const Point &p)
+{
+    // The ring has a place for each cell, and one more.
+    *s.head = (*s.head == 0 ? board.width() * board.height() + 1 : *s.head) - 1;
+    s.body[*s.head] = p;
+    (*s.length)++;
+
+    // Take the cell out of the free set, by moving
+    // the last free cell into its place.
+    int cell = p.y * board.width() + p.x;
+    if(s.occupied[cell]++ == 0)
+    {
+        int last = s.freeCells[--*s.freeCount];
+        s.freeCells[s.freeIndex[cell]] = last;
+        s.freeIndex[last] = s.freeIndex[cell];
+    }
+}
+
+template<class Board>
+void removeTail(const Board &board, const SnakeRef &s)
+{
+    int last = *s.head + *s.length - 1;
+    if(last > board.width() * board.height()) last -= board.width() * board.height() + 1;
+
+    const Point &tail = s.body[last];
+    (*s.length)--;
+
+    // Put the cell back into the free set.
+    int cell = tail.y * board.width() + tail.x;
+    if(--s.occupied[cell] == 0)
+    {
+        s.freeCells[*s.freeCount] = cell;
+        s.freeIndex[cell] = (*s.freeCount)++;
+    }
+}
+
+const Point& segment(const SlitherSim &sim, int i)
+{
+    // The i-th segment of the snake, counting from the head.
+    return sim.body[(sim.head + i) % sim.body.size()];
+}
+
+template<class Board>
+void placeFood(const Board &board, const SnakeRef &s)
+{
+    // Put the food on a free cell, picked uniformly at random.
+    // If the snake fills the board, there is nowhere to put it.
+    if(*s.freeCount == 0)
+    {
+        *s.food = Point{-1, -1};
+        return;
+    }
+
+    int cell = s.freeCells[nextRandom(*s.rng, *s.freeCount)];
+    *s.food = Point{cell % board.width(), cell / board.width()};
+}
+
+uint32_t nextRandom(uint64_t &state, uint32_t bound)
+{
+    // A random number in [0, bound), from the splitmix64 generator.
+    uint64_t z = splitmix64(state);
+    return (uint32_t)(((z >> 32) * bound) >> 32);
+}
+
+uint64_t hashSim(const SlitherSim &sim)
+{
+    // FNV-1a over everything that affects how the game plays on.
+    uint64_t hash = FNV_OFFSET;
+    int values[5] = {sim.direction, sim.length, sim.food.x, sim.food.y, (int)(sim.rng >> 32)};
+    for(int i = 0; i < 5; i++)
+    {
+        hash = fnvMix(hash, (uint32_t) values[i]);
+    }
+    for(int i = 0; i < sim.length; i++)
+    {
+        const Point &p = segment(sim, i);
+        hash = fnvMix(hash, (uint32_t)(p.y * sim.width + p.x));
+    }
+
+    return hash;
+}
+
+int runHeadless(int width, int height, long long ticks, uint64_t seed)
+{
+    return onBoard(width, height, [ticks, seed](auto board)
+    {
+        return runHeadless(board, ticks, seed);
+    });
+}
+
+template<class Board>
+int runHeadless(const Board &board, long long ticks, uint64_t seed)
+{
+    // Play without a window, turning at random about one tick in eight.
+    // The turns come from their own generator, seeded from the same seed.
+    // The rules are called directly, so they're compiled into the loop.
+    SlitherSim game;
+    initSim(game, board.width(), board.height(), seed);
+    SnakeRef s = snake(game);
+    uint64_t input = seed ^ 0xD1B54A32D192ED03ULL;
+
+    int longest = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(long long t = 0; t < ticks; t++)
+    {
+        uint32_t r = nextRandom(input, 32);
+        if(r < 4) game.direction = DIRECTIONS[r];
+
+        tick(board, s);
+        if(game.length > longest) longest = game.length;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%lld ticks in %.3fs (%.0f ticks/s), seed %llu.\n", ticks, seconds, ticks / std::max(seconds, 1e-9), (unsigned long long) seed);
+    printf("Length %d, longest %d, state hash %016llx.\n", game.length, longest, (unsigned long long) hashSim(game));
+
+    return 0;
+}
+
+bool initAutopilot(Autopilot &pilot, const SlitherSim &sim)
+{
+    // Lay a cycle over the board: along the top row, back and forth
+    // along the other rows without their first column, then up the
+    // first column. That needs an even number of rows.
+    int width = sim.width, height = sim.height, cells = width * height;
+    pilot.width = width;
+    pilot.height = height;
+
+    std::vector<int> cycle;
+    for(int x = 0; x < width; x++) cycle.push_back(x);
+    for(int y = 1; y < height; y++)
+    {
+        for(int k = 1; k < width; k++)
+        {
+            cycle.push_back(y * width + (y % 2 ? width - k : k));
+        }
+    }
+    for(int y = height - 1; y > 0; y--) cycle.push_back(y * width);
+
+    // It has to run through the starting snake from tail to head,
+    // so go around it the other way if that's what it takes.
+    if((height / 2) % 2) std::reverse(cycle.begin(), cycle.end());
+
+    pilot.order.assign(cells, 0);
+    pilot.following.assign(cells, 0);
+    for(int i = 0; i < cells; i++)
+    {
+        pilot.order[cycle[i]] = i;
+        pilot.following[cycle[i]] = cycle[(i + 1) % cells];
+    }
+
+    bool fits = height % 2 == 0;
+    for(int i = 1; fits && i < sim.length; i++)
+    {
+        const Point &p = segment(sim, i), &q = segment(sim, i - 1);
+        fits = pilot.following[p.y * width + p.x] == q.y * width + q.x;
+    }
+
+    if(!fits)
+    {
+        printf("The autopilot needs a board with an even height, at least 6 wide.\n");
+        return false;
+    }
+
+    pilot.parent.resize(cells);
+    pilot.queue.resize(cells);
+    pilot.blocked.resize(cells);
+    pilot.plans = 0;
+    pilot.totalSeconds = pilot.worstSeconds = 0;
+
+    return true;
+}
+
+int steer(Autopilot &pilot, const SlitherSim &sim)
+{
+    // The direction to go this tick, timing how long it took to decide.
+    auto start = std::chrono::steady_clock::now();
+
+    const Point &h = segment(sim, 0);
+    int direction = directionTo(sim, h.y * sim.width + h.x, planMove(pilot, sim));
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    pilot.plans++;
+    pilot.totalSeconds += seconds;
+    pilot.worstSeconds = std::max(pilot.worstSeconds, seconds);
+
+    return direction;
+}
+
+int planMove(Autopilot &pilot, const SlitherSim &sim)
+{
+    // The cell to move the head to. By default, the next one on the
+    // cycle. A shortcut along the shortest path to the food is taken
+    // if it stays ahead of the head on the cycle without passing the
+    // food or the tail, and the tail can still be reached once the
+    // snake has eaten the food.
+    int cells = sim.width * sim.height;
+    const Point &h = segment(sim, 0), &t = segment(sim, sim.length - 1);
+    int head = h.y * sim.width + h.x, tail = t.y * sim.width + t.x;
+    int next = pilot.following[head];
+
+    if(sim.food.x < 0) return next;
+    int food = sim.food.y * sim.width + sim.food.x;
+
+    // The body blocks the path, except for the tail, which moves on
+    // before the head gets there.
+    for(int i = 0; i < cells; i++) pilot.blocked[i] = sim.occupied[i];
+    pilot.blocked[tail] = 0;
+
+    if(!findPath(pilot, head, food)) return next;
+
+    int step = pilot.path[0];
+    int ahead = (pilot.order[step] - pilot.order[head] + cells) % cells;
+    int toFood = (pilot.order[food] - pilot.order[head] + cells) % cells;
+    int toTail = (pilot.order[tail] - pilot.order[head] + cells) % cells;
+    if(ahead == 0 || ahead > toFood || ahead >= toTail) return next;
+
+    return keepsTail(pilot, sim) ? step : next;
+}
+
+bool findPath(Autopilot &pilot, int from, int to)
+{
+    // Breadth first search across unblocked cells, wrapping around the
+    // edges like the snake does. On success, path holds the cells
+    // after from, up to and including to.
+    int width = pilot.width, height = pilot.height;
+    std::fill(pilot.parent.begin(), pilot.parent.end(), -1);
+    pilot.parent[from] = from;
+
+    int first = 0, last = 0;
+    pilot.queue[last++] = from;
+    while(first < last && pilot.parent[to] < 0)
+    {
+        int cell = pilot.queue[first++];
+        int x = cell % width, y = cell / width;
+        int neighbours[4] = {y * width + wrap(x - 1, width), wrap(y - 1, height) * width + x,
+            y * width + wrap(x + 1, width), wrap(y + 1, height) * width + x};
+
+        for(int n : neighbours)
+        {
+            if(pilot.parent[n] < 0 && (!pilot.blocked[n] || n == to))
+            {
+                pilot.parent[n] = cell;
+                pilot.queue[last++] = n;
+            }
+        }
+    }
+
+    if(pilot.parent[to] < 0) return false;
+
+    pilot.path.clear();
+    for(int cell = to; cell != from; cell = pilot.parent[cell]) pilot.path.push_back(cell);
+    std::reverse(pilot.path.begin(), pilot.path.end());
+
+    return true;
+}
+
+bool keepsTail(Autopilot &pilot, const SlitherSim &sim)
+{
+    // Play the path to the food on a copy of the board, and check that
+    // the head could then still follow the tail around, so the snake
+    // isn't boxed in by its own body.
+    int cells = sim.width * sim.height;
+    for(int i = 0; i < cells; i++) pilot.blocked[i] = sim.occupied[i];
+
+    // The body from tail to head, then the path. As the head moves
+    // along the path, the tail moves along this, except for the
+    // move that eats the food.
+    pilot.cells.clear();
+    for(int i = sim.length - 1; i >= 0; i--)
+    {
+        const Point &p = segment(sim, i);
+        pilot.cells.push_back(p.y * sim.width + p.x);
+    }
+    pilot.cells.insert(pilot.cells.end(), pilot.path.begin(), pilot.path.end());
+
+    int steps = pilot.path.size();
+    for(int i = 0; i < steps; i++)
+    {
+        if(i + 1 < steps) pilot.blocked[pilot.cells[i]]--;
+        pilot.blocked[pilot.path[i]]++;
+    }
+
+    int head = pilot.path.back(), tail = pilot.cells[steps - 1];
+    if(head == tail) return true;
+
+    std::vector<int> path;
+    path.swap(pilot.path);
+    bool reachable = findPath(pilot, head, tail);
+    path.swap(pilot.path);
+
+    return reachable;
+}
+
+int directionTo(const SlitherSim &sim, int from, int to)
+{
+    // The direction that moves the head from one cell to the next.
+    int x = from % sim.width, y = from / sim.width;
+    if(to == y * sim.width + wrap(x - 1, sim.width)) return LEFT;
+    if(to == wrap(y - 1, sim.height) * sim.width + x) return UP;
+    if(to == y * sim.width + wrap(x + 1, sim.width)) return RIGHT;
+    return DOWN;
+}
+
+void reportAutopilot(const Autopilot &pilot)
+{
+    if(pilot.plans == 0) return;
+
+    printf("Planner: %lld moves, %.2f us mean, %.2f us worst.\n", pilot.plans,
+        pilot.totalSeconds * 1e6 / pilot.plans, pilot.worstSeconds * 1e6);
+}
+
+int runAutopilot(int width, int height, long long ticks, uint64_t seed, const char* recordPath)
+{
+    // Let the autopilot play without a window, until the snake fills
+    // the board or ticks run out. A bite would be a planner bug,
+    // and fails the run. The game is saved as a replay if asked.
+    SlitherSim game;
+    initSim(game, width, height, seed);
+
+    Autopilot pilot;
+    Recording recording{nullptr, 0, 0, 0};
+    if(!initAutopilot(pilot, game) || (recordPath && !startRecording(recording, recordPath, game, seed))) return 1;
+
+    int bites = 0;
+    long long t = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(t < ticks && game.length < width * height)
+    {
+        game.direction = steer(pilot, game);
+        if(recording.file) recordTick(recording, game.direction);
+        if(update(game) == BIT) bites++;
+        t++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%lld ticks in %.3fs on a %dx%d board, seed %llu.\n", t, seconds, width, height, (unsigned long long) seed);
+    printf("Length %d of %d, %d bites, state hash %016llx.\n", game.length, width * height, bites,
+        (unsigned long long) hashSim(game));
+    reportAutopilot(pilot);
+
+    if(recording.file) finishRecording(recording, game);
+
+    return bites == 0 ? 0 : 1;
+}
+
+bool startRecording(Recording &recording, const char* path, const SlitherSim &sim, uint64_t seed)
+{
+    recording.file = fopen(path, "w");
+    if(!recording.file)
+    {
+        printf("Could not write replay to '%s'!\n", path);
+        return false;
+    }
+
+    fprintf(recording.file, "%s\nboard %d %d\nseed %llu\n", REPLAY_MAGIC, sim.width, sim.height, (unsigned long long) seed);
+    recording.direction = sim.direction;
+    recording.run = recording.ticks = 0;
+
+    return true;
+}
+
+void recordTick(Recording &recording, int direction)
+{
+    // Note the direction the snake goes this tick. A run is only
+    // written out once the direction changes.
+    if(direction != recording.direction && recording.run > 0)
+    {
+        int d = std::find(DIRECTIONS, DIRECTIONS + 4, recording.direction) - DIRECTIONS;
+        fprintf(recording.file, "%c %lld\n", DIRECTION_CHARS[d], recording.run);
+        recording.run = 0;
+    }
+
+    recording.direction = direction;
+    recording.run++;
+    recording.ticks++;
+}
+
+void finishRecording(Recording &recording, const SlitherSim &sim)
+{
+    if(recording.run > 0)
+    {
+        int d = std::find(DIRECTIONS, DIRECTIONS + 4, recording.direction) - DIRECTIONS;
+        fprintf(recording.file, "%c %lld\n", DIRECTION_CHARS[d], recording.run);
+    }
+
+    fprintf(recording.file, "end %lld %016llx\n", recording.ticks, (unsigned long long) hashSim(sim));
+    fclose(recording.file);
+    recording.file = nullptr;
+}
+
+bool openReplay(Replay &replay, const char* path)
+{
+    // Read the header. The runs are read as they're played.
+    replay.file = fopen(path, "r");
+    if(!replay.file)
+    {
+        printf("Could not open replay '%s'!\n", path);
+        return false;
+    }
+
+    char magic[64] = "";
+    unsigned long long seed = 0;
+    if(!fgets(magic, sizeof(magic), replay.file) || strncmp(magic, REPLAY_MAGIC, strlen(REPLAY_MAGIC)) != 0 ||
+        fscanf(replay.file, " board %d %d seed %llu", &replay.width, &replay.height, &seed) != 3)
+    {
+        printf("'%s' is not a Slither replay!\n", path);
+        fclose(replay.file);
+        replay.file = nullptr;
+        return false;
+    }
+
+    replay.seed = seed;
+    replay.direction = RIGHT;
+    replay.left = 0;
+    replay.ended = false;
+
+    return true;
+}
+
+bool replayTick(Replay &replay, int &direction)
+{
+    // The direction to go this tick, or false once the replay is over.
+    while(replay.left == 0 && !replay.ended)
+    {
+        char letter[8];
+        long long count = 0;
+        if(fscanf(replay.file, " %7s %lld", letter, &count) != 2)
+        {
+            printf("The replay ends without an end line!\n");
+            replay.ended = true;
+            replay.ticks = -1;
+        }
+        else if(strcmp(letter, "end") == 0)
+        {
+            unsigned long long hash = 0;
+            bool read = fscanf(replay.file, " %llx", &hash) == 1;
+            replay.ended = true;
+            replay.ticks = read ? count : -1;
+            replay.hash = hash;
+        }
+        else
+        {
+            const char* d = letter[1] == 0 ? strchr(DIRECTION_CHARS, letter[0]) : nullptr;
+            if(!d || count < 0)
+            {
+                printf("The replay has a bad run '%s %lld'!\n", letter, count);
+                replay.ended = true;
+                replay.ticks = -1;
+            }
+            else
+            {
+                replay.direction = DIRECTIONS[d - DIRECTION_CHARS];
+                replay.left = count;
+            }
+        }
+    }
+
+    if(replay.left == 0) return false;
+
+    replay.left--;
+    direction = replay.direction;
+    return true;
+}
+
+bool checkReplay(Replay &replay, const SlitherSim &sim, long long played)
+{
+    // Compare the game the replay played out with how it was recorded.
+    uint64_t hash = hashSim(sim);
+    bool matches = replay.ticks == played && replay.hash == hash;
+
+    if(matches)
+    {
+        printf("Replay matches: %lld ticks, length %d, state hash %016llx.\n", played, sim.length, (unsigned long long) hash);
+    }
+    else
+    {
+        printf("Replay does not match! Recorded %lld ticks, hash %016llx, played %lld ticks, hash %016llx.\n",
+            replay.ticks, (unsigned long long) replay.hash, played, (unsigned long long) hash);
+    }
+
+    return matches;
+}
+
+int verifyReplay(const char* path)
+{
+    // Play a replay back without a window, as fast as possible, and check
+    // that it ends where it was recorded ending.
+    Replay replay{nullptr, 0, 0, 0, 0, 0, false, 0, 0};
+    if(!openReplay(replay, path)) return 1;
+
+    if(replay.width < 4 || replay.height < 2 || replay.width > MAX_BOARD || replay.height > MAX_BOARD)
+    {
+        printf("The replay's board is %dx%d, which can't be played.\n", replay.width, replay.height);
+        fclose(replay.file);
+        return 1;
+    }
+
+    SlitherSim game;
+    initSim(game, replay.width, replay.height, replay.seed);
+
+    long long played = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(replayTick(replay, game.direction))
+    {
+        update(game);
+        played++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Played %lld ticks in %.3fs (%.0f ticks/s).\n", played, seconds, played / std::max(seconds, 1e-9));
+    bool matches = checkReplay(replay, game, played);
+
+    fclose(replay.file);
+    return matches ? 0 : 1;
+}
+
+void initBatch(SlitherBatch &batch, int count, int width, int height, uint64_t seed, int threads)
+{
+    // Set up count games, each seeded differently, stepped on threads threads.
+    int cells = width * height;
+
+    batch.count = count;
+    batch.width = width;
+    batch.height = height;
+    batch.direction.resize(count);
+    batch.length.resize(count);
+    batch.head.resize(count);
+    batch.freeCount.resize(count);
+    batch.food.resize(count);
+    batch.rng.resize(count);
+    batch.body.resize((size_t) count * (cells + 1));
+    batch.occupied.resize((size_t) count * cells);
+    batch.freeCells.resize((size_t) count * cells);
+    batch.freeIndex.resize((size_t) count * cells);
+
+    onBoard(width, height, [&batch, count, seed](auto board)
+    {
+        batch.step = &stepGames<decltype(board)>;
+        for(int i = 0; i < count; i++)
+        {
+            uint64_t gameSeed = seed + i;
+            nextRandom(gameSeed, 1);
+            resetSnake(board, batchSnake(batch, i), gameSeed);
+        }
+        return 0;
+    });
+
+    batch.generation = 0;
+    batch.busy = 0;
+    batch.stopping = false;
+    for(int id = 1; id < threads && id < count; id++)
+    {
+        batch.workers.push_back(std::thread(batchWorker, &batch, id));
+    }
+}
+
+SnakeRef batchSnake(SlitherBatch &batch, int i)
+{
+    size_t cells = (size_t) batch.width * batch.height;
+    return SnakeRef{batch.width, batch.height, &batch.direction[i], &batch.length[i], &batch.head[i],
+        &batch.body[i * (cells + 1)], &batch.occupied[i * cells], &batch.freeCells[i * cells],
+        &batch.freeIndex[i * cells], &batch.freeCount[i], &batch.food[i], &batch.rng[i]};
+}
+
+void stepBatch(SlitherBatch &batch, const uint8_t* actions, uint8_t* observations, float* rewards, uint8_t* dones)
+{
+    // Step every game once. actions holds one action per game. For each game,
+    // observations receives width * height cells in row order, rewards
+    // +1 for eating and -1 for biting, and dones 1 if the snake bit itself.
+    // Any output buffer may be null.
+    batch.actions = actions;
+    batch.observations = observations;
+    batch.rewards = rewards;
+    batch.dones = dones;
+
+    int shares = batch.workers.size() + 1;
+    {
+        std::lock_guard<std::mutex> guard(batch.lock);
+        batch.generation++;
+        batch.busy = batch.workers.size();
+    }
+    batch.wake.notify_all();
+
+    batch.step(batch, 0, batch.count / shares);
+
+    std::unique_lock<std::mutex> guard(batch.lock);
+    batch.finished.wait(guard, [&batch] { return batch.busy == 0; });
+}
+
+template<class Board>
+void stepGames(SlitherBatch &batch, int begin, int end)
+{
+    Board board(batch.width, batch.height);
+    int cells = board.width() * board.height();
+    for(int i = begin; i < end; i++)
+    {
+        SnakeRef s = batchSnake(batch, i);
+
+        uint8_t action = batch.actions ? batch.actions[i] : KEEP_DIRECTION;
+        if(action < 4) *s.direction = DIRECTIONS[action];
+
+        int result = tick(board, s);
+        if(batch.rewards) batch.rewards[i] = (float) result;
+        if(batch.dones) batch.dones[i] = result == BIT;
+
+        if(batch.observations)
+        {
+            uint8_t* obs = batch.observations + (size_t) i * cells;
+            for(int c = 0; c < cells; c++)
+            {
+                obs[c] = s.occupied[c] ? OBS_BODY : OBS_EMPTY;
+            }
+
+            const Point &h = s.body[*s.head];
+            obs[h.y * board.width() + h.x] = OBS_HEAD;
+            if(s.food->x >= 0) obs[s.food->y * board.width() + s.food->x] = OBS_FOOD;
+        }
+    }
+}
+
+void batchWorker(SlitherBatch* batch, int id)
+{
+    // Wait for a step, do this worker's share of the games, and repeat.
+    long long seen = 0;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(batch->lock);
+            batch->wake.wait(guard, [batch, seen] { return batch->stopping || batch->generation != seen; });
+            if(batch->stopping) return;
+            seen = batch->generation;
+        }
+
+        int count = batch->workers.size() + 1;
+        batch->step(*batch, (long long) batch->count * id / count, (long long) batch->count * (id + 1) / count);
+
+        std::lock_guard<std::mutex> guard(batch->lock);
+        if(--batch->busy == 0) batch->finished.notify_one();
+    }
+}
+
+void closeBatch(SlitherBatch &batch)
+{
+    {
+        std::lock_guard<std::mutex> guard(batch.lock);
+        batch.stopping = true;
+    }
+    batch.wake.notify_all();
+
+    for(unsigned int i = 0; i < batch.workers.size(); i++)
+    {
+        batch.workers[i].join();
+    }
+    batch.workers.clear();
+}
+
+int runBatch(int count, int width, int height, long long ticks, uint64_t seed, int threads)
+{
+    // Step count games for ticks steps with random actions,
+    // and report how many game steps a second that makes.
+    SlitherBatch batch;
+    initBatch(batch, count, width, height, seed, threads);
+
+    std::vector<uint8_t> actions(count), observations((size_t) count * width * height), dones(count);
+    std::vector<float> rewards(count);
+    uint64_t input = seed ^ 0xD1B54A32D192ED03ULL;
+
+    double eaten = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(long long t = 0; t < ticks; t++)
+    {
+        for(int i = 0; i < count; i++)
+        {
+            uint32_t r = nextRandom(input, 32);
+            actions[i] = r < 4 ? r : KEEP_DIRECTION;
+        }
+
+        stepBatch(batch, actions.data(), observations.data(), rewards.data(), dones.data());
+
+        for(int i = 0; i < count; i++)
+        {
+            if(rewards[i] > 0) eaten += rewards[i];
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    closeBatch(batch);
+
+    printf("%d games x %lld ticks in %.3fs (%.0f game ticks/s), %.0f food eaten.\n",
+        count, ticks, seconds, count * ticks / seconds, eaten);
+
+    return 0;
+}
+
+int opposite(int direction)
+{
+    switch(direction)
+    {
+        case LEFT: return RIGHT;
+        case RIGHT: return LEFT;
+        case UP: return DOWN;
+        case DOWN: return UP;
+    }
+
+    return direction;
+}
@@ -0,0 +1,237 @@
+/*
+ * Slither (a Snake clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef SLITHER_CORE_H
+#define SLITHER_CORE_H
+
+#include "hash.h"
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <stdio.h>
+
+struct Point
+{
+    int x, y;
+};
+
+// The board is 20x20 unless `--board W H` says otherwise.
+const int B_WIDTH = 20;
+const int B_HEIGHT = 20;
+
+// Boards bigger than this can't be played.
+const int MAX_BOARD = 4096;
+
+// Directions, in the order of DIRECTION_CHARS.
+const int LEFT = 0;
+const int UP = 1;
+const int RIGHT = 2;
+const int DOWN = 3;
+
+constexpr int DIRECTIONS[4] = {LEFT, UP, RIGHT, DOWN};
+
+// What a tick did to the snake.
+const int MOVED = 0;
+const int ATE = 1;
+const int BIT = -1;
+
+// Cell values in batch observations.
+const uint8_t OBS_EMPTY = 0;
+const uint8_t OBS_BODY = 1;
+const uint8_t OBS_HEAD = 2;
+const uint8_t OBS_FOOD = 3;
+
+// Batch actions: a direction index into DIRECTIONS, or this to keep going.
+const uint8_t KEEP_DIRECTION = 0xFF;
+
+// Where each piece of one game's state is kept. The rules of the game
+// are written against this, so they work the same on a SlitherSim and
+// on one game of a SlitherBatch.
+struct SnakeRef
+{
+    int width, height;
+    int* direction;
+    int* length;
+    int* head;
+    Point* body;
+    unsigned char* occupied;
+    int* freeCells;
+    int* freeIndex;
+    int* freeCount;
+    Point* food;
+    uint64_t* rng;
+};
+
+// The whole state of a game of Slither. It has its own random number
+// generator, so the same seed and inputs always play out the same way.
+struct SlitherSim
+{
+    int width, height;
+
+    int direction;
+
+    // The snake's body, stored in a ring buffer. The head is at body[head],
+    // and each following segment is one place further along the ring.
+    // The snake can cover the whole board, plus one segment for the
+    // moment its head moves onto its own body.
+    int length;
+    int head;
+    std::vector<Point> body;
+
+    // How many segments cover each cell of the board, by y * width + x.
+    std::vector<unsigned char> occupied;
+
+    // The cells no segment covers, as y * width + x, in no particular
+    // order. freeIndex gives each free cell's position in freeCells, so a
+    // cell can be taken out by swapping the last free cell into its place.
+    std::vector<int> freeCells;
+    std::vector<int> freeIndex;
+    int freeCount;
+
+    Point food;
+
+    uint64_t rng;
+
+    // The rules, compiled for this board size.
+    int (*tick)(const SnakeRef&);
+};
+
+// Many games stepped together, for training agents. Each piece of state
+// is kept for all games in one array (structure of arrays), with the
+// per-game arrays of a game stored next to each other.
+struct SlitherBatch
+{
+    int count;
+    int width, height;
+
+    std::vector<int> direction, length, head, freeCount;
+    std::vector<Point> food;
+    std::vector<uint64_t> rng;
+
+    std::vector<Point> body;               // width * height + 1 per game.
+    std::vector<unsigned char> occupied;   // width * height per game.
+    std::vector<int> freeCells, freeIndex; // width * height per game.
+
+    // The buffers of the step in progress, owned by the caller.
+    const uint8_t* actions;
+    uint8_t* observations;
+    float* rewards;
+    uint8_t* dones;
+
+    // Worker threads each step their share of the games. The caller's
+    // thread steps the first share, then waits for the rest.
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, finished;
+    long long generation;
+    int busy;
+    bool stopping;
+
+    // Steps a range of games, compiled for this board size.
+    void (*step)(SlitherBatch&, int, int);
+};
+
+// Steers the snake by itself. It follows a Hamiltonian cycle of the
+// board, which visits every cell once, and takes a shortcut toward the
+// food when that can't trap it. The body always lies along the cycle in
+// order from tail to head, so following the cycle never runs into it.
+struct Autopilot
+{
+    int width, height;
+
+    // Each cell's place on the cycle, and the cell after it.
+    std::vector<int> order;
+    std::vector<int> following;
+
+    // Scratch space for the planner.
+    std::vector<int> parent, queue, path, cells;
+    std::vector<unsigned char> blocked;
+
+    // How long planning has taken.
+    long long plans;
+    double totalSeconds, worstSeconds;
+};
+
+// Replays are text: a header giving the board size and seed, then each
+// run of ticks spent going one way as a direction letter and a count,
+// like "R 37", then "end", the number of ticks and the final state hash.
+// They're written and read a line at a time, so any length of game
+// takes the same memory.
+const char REPLAY_MAGIC[] = "SLITHER REPLAY 2";
+const char DIRECTION_CHARS[] = "LURD";
+
+struct Recording
+{
+    FILE* file;
+    int direction;
+    long long run, ticks;
+};
+
+struct Replay
+{
+    FILE* file;
+    int width, height;
+    uint64_t seed;
+
+    // The direction being played, and for how many more ticks.
+    int direction;
+    long long left;
+
+    // Filled in from the end line, once it's reached.
+    bool ended;
+    long long ticks;
+    uint64_t hash;
+};
+
+// Function prototypes.
+void initSim(SlitherSim&, int, int, uint64_t);
+SnakeRef snake(SlitherSim&);
+int update(SlitherSim&);
+int wrap(int, int);
+int opposite(int);
+const Point& segment(const SlitherSim&, int);
+uint32_t nextRandom(uint64_t&, uint32_t);
+uint64_t hashSim(const SlitherSim&);
+int runHeadless(int, int, long long, uint64_t);
+bool initAutopilot(Autopilot&, const SlitherSim&);
+int steer(Autopilot&, const SlitherSim&);
+int planMove(Autopilot&, const SlitherSim&);
+bool findPath(Autopilot&, int, int);
+bool keepsTail(Autopilot&, const SlitherSim&);
+int directionTo(const SlitherSim&, int, int);
+void reportAutopilot(const Autopilot&);
+int runAutopilot(int, int, long long, uint64_t, const char*);
+bool startRecording(Recording&, const char*, const SlitherSim&, uint64_t);
+void recordTick(Recording&, int);
+void finishRecording(Recording&, const SlitherSim&);
+bool openReplay(Replay&, const char*);
+bool replayTick(Replay&, int&);
+bool checkReplay(Replay&, const SlitherSim&, long long);
+int verifyReplay(const char*);
+void initBatch(SlitherBatch&, int, int, int, uint64_t, int);
+SnakeRef batchSnake(SlitherBatch&, int);
+void stepBatch(SlitherBatch&, const uint8_t*, uint8_t*, float*, uint8_t*);
+void batchWorker(SlitherBatch*, int);
+void closeBatch(SlitherBatch&);
+int runBatch(int, int, int, long long, uint64_t, int);
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * Slither (a Snake clone)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "slither_core.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Function prototypes.
+bool check(bool, const char*);
+uint64_t playRandom(SlitherSim&, int, int, long long, uint64_t);
+int testPinned();
+int testBatch();
+int testReplay();
+
+int main()
+{
+    // Checks of the Slither core that the benchmarks don't make.
+    // Returns 1 if any of them fail.
+    int result = 0;
+    result |= testPinned();
+    result |= testBatch();
+    result |= testReplay();
+
+    printf(result ? "Some checks failed.\n" : "All checks passed.\n");
+    return result;
+}
+
+bool check(bool passed, const char* what)
+{
+    if(!passed) printf("FAILED: %s\n", what);
+    return passed;
+}
+
+uint64_t playRandom(SlitherSim &sim, int width, int height, long long ticks, uint64_t seed)
+{
+    // Play the game runHeadless plays, and return its state hash.
+    initSim(sim, width, height, seed);
+    uint64_t input = seed ^ 0xD1B54A32D192ED03ULL;
+    for(long long t = 0; t < ticks; t++)
+    {
+        uint32_t r = nextRandom(input, 32);
+        if(r < 4) sim.direction = DIRECTIONS[r];
+
+        update(sim);
+    }
+
+    return hashSim(sim);
+}
+
+int testPinned()
+{
+    // The same seed and turns must always play out the same way, on a
+    // board size with compiled rules and on one without. A change to
+    // the rules, the generator or the hash shows up here.
+    SlitherSim sim;
+    bool passed = check(playRandom(sim, 20, 20, 10000, 1) == 0x554469ff0825072bULL, "a 20x20 game ends where it always has");
+    passed &= check(playRandom(sim, 21, 10, 10000, 1) == 0xf361ee589a648fcfULL, "a 21x10 game ends where it always has");
+
+    return passed ? 0 : 1;
+}
+
+int testBatch()
+{
+    // Each game of a batch plays exactly like a single game seeded the
+    // way initBatch seeds it.
+    const int count = 37, width = 12, height = 9, ticks = 3000;
+    SlitherBatch batch;
+    initBatch(batch, count, width, height, 5, 3);
+
+    std::vector<SlitherSim> sims(count);
+    for(int i = 0; i < count; i++)
+    {
+        uint64_t gameSeed = 5 + i;
+        nextRandom(gameSeed, 1);
+        initSim(sims[i], width, height, gameSeed);
+    }
+
+    std::vector<uint8_t> actions(count), observations(count * width * height), dones(count);
+    std::vector<float> rewards(count);
+    uint64_t input = 7;
+
+    bool passed = true;
+    for(int t = 0; t < ticks && passed; t++)
+    {
+        for(int i = 0; i < count; i++)
+        {
+            uint32_t r = nextRandom(input, 32);
+            actions[i] = r < 4 ? r : KEEP_DIRECTION;
+        }
+        stepBatch(batch, actions.data(), observations.data(), rewards.data(), dones.data());
+
+        for(int i = 0; i < count && passed; i++)
+        {
+            if(actions[i] != KEEP_DIRECTION) sims[i].direction = DIRECTIONS[actions[i]];
+            int result = update(sims[i]);
+
+            passed &= check(rewards[i] == result && dones[i] == (result == BIT), "a batch game is rewarded like a single game");
+            passed &= check(batch.length[i] == sims[i].length && batch.food[i].x == sims[i].food.x
+                && batch.food[i].y == sims[i].food.y, "a batch game moves like a single game");
+        }
+    }
+
+    closeBatch(batch);
+    return passed ? 0 : 1;
+}
+
+int testReplay()
+{
+    // A recorded autopilot game must replay to the same end, and a
+    // replay that has been tampered with must not.
+    const char* path = "/tmp/slither_test.replay";
+    bool passed = check(runAutopilot(8, 6, 100000, 1, path) == 0, "the autopilot fills an 8x6 board without biting itself");
+    passed &= check(verifyReplay(path) == 0, "the autopilot's replay matches");
+
+    std::string text;
+    FILE* file = fopen(path, "r");
+    char buffer[4096];
+    size_t read;
+    while(file && (read = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, read);
+    if(file) fclose(file);
+
+    // Flip the last digit of the final state hash.
+    size_t last = text.find_last_not_of("\n");
+    passed &= check(last != std::string::npos && text.rfind("end ", last) != std::string::npos, "the replay has an end line");
+    if(last != std::string::npos)
+    {
+        text[last] = text[last] == '0' ? '1' : '0';
+
+        file = fopen(path, "w");
+        if(file)
+        {
+            fwrite(text.data(), 1, text.size(), file);
+            fclose(file);
+        }
+        passed &= check(verifyReplay(path) != 0, "a tampered replay doesn't match");
+    }
+
+    remove(path);
+    return passed ? 0 : 1;
+}
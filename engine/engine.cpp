@@ -0,0 +1,428 @@
+/*
+ * Engine (the window, grid drawing and timing the games share)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "engine.h"
+
+#include <algorithm>
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+SDL_Window* window = nullptr;
+SDL_Renderer* renderer = nullptr;
+SDL_Surface* offscreen = nullptr;
+
+bool fullscreen = true;
+
+int W_WIDTH = 0;
+int W_HEIGHT = 0;
+
+int cellSize = 0, xp = 0, yp = 0;
+
+long long drawCalls = 0;
+
+Timing timing;
+
+void readWindowArgs(int argc, char* args[])
+{
+    // Allow a `-w` flag to launch in windowed mode.
+    // Can be followed by width and height: `-w 800 600`.
+    // Defaults to 800x600.
+    for(int i = 0; i < argc; i++)
+    {
+        if(strcmp(args[i], "-w") == 0)
+        {
+            fullscreen = false;
+            if(i + 2 < argc)
+            {
+                W_WIDTH = atoi(args[i + 1]);
+                W_HEIGHT = atoi(args[i + 2]);
+            }
+            else
+            {
+                W_WIDTH = 800;
+                W_HEIGHT = 600;
+            }
+        }
+    }
+}
+
+bool initWindow(const char* title)
+{
+    // Initialize SDL.
+    if(SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        printf("SDL could not initialise! SDL_Error: %s\n", SDL_GetError());
+    }
+    else
+    {
+        // Create window.
+        int flags = SDL_WINDOW_SHOWN;
+        if(fullscreen)
+        {
+            flags |= SDL_WINDOW_FULLSCREEN;
+        }
+
+        window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, W_WIDTH, W_HEIGHT, flags);
+        if(window == NULL)
+        {
+            printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+
+            SDL_Quit();
+        }
+        else
+        {
+            // Set the renderer, which will be used as
+            // the base for all drawing operations.
+            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+            if(renderer == NULL)
+            {
+                printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+
+                SDL_DestroyWindow(window);
+                SDL_Quit();
+            }
+            else
+            {
+                if(fullscreen)
+                {
+                    // Set the W_WIDTH and W_HEIGHT variables.
+                    SDL_GL_GetDrawableSize(window, &W_WIDTH, &W_HEIGHT);
+                }
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool initOffscreen()
+{
+    // Draw with the software renderer into a surface in memory, so
+    // no window or GPU is needed. SDL is started on its dummy video
+    // driver, unless SDL_VIDEODRIVER asks for another.
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    if(SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        printf("SDL could not initialise! SDL_Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    if(W_WIDTH <= 0 || W_HEIGHT <= 0)
+    {
+        W_WIDTH = 800;
+        W_HEIGHT = 600;
+    }
+
+    offscreen = SDL_CreateRGBSurfaceWithFormat(0, W_WIDTH, W_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if(offscreen == NULL)
+    {
+        printf("Surface could not be created! SDL_Error: %s\n", SDL_GetError());
+
+        SDL_Quit();
+        return false;
+    }
+
+    renderer = SDL_CreateSoftwareRenderer(offscreen);
+    if(renderer == NULL)
+    {
+        printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+
+        SDL_FreeSurface(offscreen);
+        SDL_Quit();
+        return false;
+    }
+
+    return true;
+}
+
+void closeWindow()
+{
+    // Destroy the renderer, and the window or surface
+    // it drew to, and quit SDL. Textures go first.
+    SDL_DestroyRenderer(renderer);
+    if(window) SDL_DestroyWindow(window);
+    if(offscreen) SDL_FreeSurface(offscreen);
+    SDL_Quit();
+
+    renderer = nullptr;
+    window = nullptr;
+    offscreen = nullptr;
+}
+
+void layoutGrid(int width, int height, int minCellSize)
+{
+    // Determine cell size based on grid and window dimensions.
+    // Allows the drawn grid to scale to the window size, down
+    // to minCellSize. Larger grids overflow the window.
+    cellSize = (int)std::min(W_WIDTH / width, W_HEIGHT / height);
+    cellSize = std::max(cellSize, minCellSize);
+
+    // Determine x and y padding, which are
+    // used to centre the grid within the window.
+    xp = (int)((W_WIDTH - (cellSize * width)) / 2);
+    yp = (int)((W_HEIGHT - (cellSize * height)) / 2);
+}
+
+int arrowDirection(int scancode)
+{
+    // The direction of an arrow key, as the games number them.
+    // Other keys are -1.
+    switch(scancode)
+    {
+        case SDL_SCANCODE_LEFT: return ARROW_LEFT;
+        case SDL_SCANCODE_UP: return ARROW_UP;
+        case SDL_SCANCODE_RIGHT: return ARROW_RIGHT;
+        case SDL_SCANCODE_DOWN: return ARROW_DOWN;
+    }
+
+    return -1;
+}
+
+SDL_Rect gridCell(float x, float y)
+{
+    // Where the cell at (x, y) is drawn, leaving a one pixel gap
+    // on its right and bottom. Fractions of a cell are allowed,
+    // for things moving between cells.
+    return SDL_Rect{(int)(x * cellSize) + xp, (int)(y * cellSize) + yp, cellSize - 1, cellSize - 1};
+}
+
+void drawBatch(CellBatch &batch)
+{
+    // Draw the batch, then empty it for the next frame.
+    SDL_SetRenderDrawColor(renderer, batch.r, batch.g, batch.b, 0xFF);
+    fillRects(batch.rects.data(), batch.rects.size());
+    batch.rects.clear();
+}
+
+// The renderer's drawing calls, counted as they're made.
+int fillRect(const SDL_Rect* rect)
+{
+    drawCalls++;
+    return SDL_RenderFillRect(renderer, rect);
+}
+
+int fillRects(const SDL_Rect* rects, int count)
+{
+    drawCalls++;
+    return SDL_RenderFillRects(renderer, rects, count);
+}
+
+int copyTexture(SDL_Texture* texture, const SDL_Rect* from, const SDL_Rect* to)
+{
+    drawCalls++;
+    return SDL_RenderCopy(renderer, texture, from, to);
+}
+
+int clearTarget()
+{
+    drawCalls++;
+    return SDL_RenderClear(renderer);
+}
+
+int drawLine(int x1, int y1, int x2, int y2)
+{
+    drawCalls++;
+    return SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+}
+
+Uint64 startTiming()
+{
+    return SDL_GetPerformanceCounter();
+}
+
+void endTiming(int phase, Uint64 start)
+{
+    // Count the time since start against phase.
+    if(timing.nsPerCount == 0) timing.nsPerCount = 1e9 / SDL_GetPerformanceFrequency();
+
+    uint64_t ns = (SDL_GetPerformanceCounter() - start) * timing.nsPerCount;
+    Histogram &h = timing.phases[phase];
+    h.counts[bucketOf(ns)]++;
+    h.count++;
+    h.total += ns;
+    if(ns > h.worst) h.worst = ns;
+}
+
+int bucketOf(uint64_t ns)
+{
+    if(ns < 4) return ns;
+
+    int top = 63 - __builtin_clzll(ns);
+    return (top - 1) * 4 + ((ns >> (top - 2)) & 3);
+}
+
+uint64_t bucketStart(int bucket)
+{
+    if(bucket < 4) return bucket;
+
+    return (uint64_t)(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+uint64_t percentile(const Histogram &h, double q)
+{
+    // The end of the bucket holding the q-th quantile, in ns.
+    uint64_t rank = q * h.count, seen = 0;
+    for(int b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+        seen += h.counts[b];
+        if(seen > rank) return std::min(b + 1 < HISTOGRAM_BUCKETS ? bucketStart(b + 1) : h.worst, h.worst);
+    }
+
+    return h.worst;
+}
+
+int pollEvent(SDL_Event* event)
+{
+    Uint64 start = startTiming();
+    int pending = SDL_PollEvent(event);
+    endTiming(PHASE_EVENTS, start);
+
+    return pending;
+}
+
+void present()
+{
+    // Show the frame, with the timing overlay on top if it's on.
+    if(timing.overlay) drawOverlay();
+
+    Uint64 start = startTiming();
+    SDL_RenderPresent(renderer);
+    endTiming(PHASE_PRESENT, start);
+}
+
+void drawOverlay()
+{
+    // A bar for each phase, in the order of PHASE_NAMES: the thick part
+    // reaches the median time, the thin part the 99th percentile. There
+    // are 20 pixels to a millisecond, and the white line is 60 Hz.
+    const Uint8 colours[PHASE_COUNT][3] = {{0x44, 0x88, 0xFF}, {0x00, 0xFF, 0x00}, {0xFF, 0xFF, 0x00}, {0xFF, 0x44, 0x44}};
+    const double PIXELS_PER_NS = 20 / 1e6;
+
+    SDL_Rect panel{4, 4, 360, PHASE_COUNT * 14 + 6};
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xC0);
+    fillRect(&panel);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+    for(int p = 0; p < PHASE_COUNT; p++)
+    {
+        const Histogram &h = timing.phases[p];
+        int y = 8 + p * 14;
+        int median = std::min(350.0, percentile(h, 0.5) * PIXELS_PER_NS + 1);
+        int tail = std::min(350.0, percentile(h, 0.99) * PIXELS_PER_NS + 1);
+
+        SDL_SetRenderDrawColor(renderer, colours[p][0], colours[p][1], colours[p][2], 0xFF);
+        SDL_Rect bars[2] = {{8, y, median, 8}, {8, y + 9, tail, 2}};
+        fillRects(bars, h.count > 0 ? 2 : 0);
+    }
+
+    int budget = 8 + (int)(1e9 / 60 * PIXELS_PER_NS);
+    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+    drawLine(budget, panel.y, budget, panel.y + panel.h - 1);
+}
+
+void printTiming()
+{
+    printf("%-8s %10s %10s %10s %10s %10s\n", "phase", "count", "mean us", "p50 us", "p99 us", "max us");
+    for(int p = 0; p < PHASE_COUNT; p++)
+    {
+        const Histogram &h = timing.phases[p];
+        if(h.count == 0) continue;
+
+        printf("%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", PHASE_NAMES[p], (unsigned long long) h.count,
+            h.total / 1e3 / h.count, percentile(h, 0.5) / 1e3, percentile(h, 0.99) / 1e3, h.worst / 1e3);
+    }
+}
+
+bool dumpTiming(const char* path)
+{
+    // Write every histogram to path, as JSON if it ends in ".json" and
+    // as CSV otherwise. Only buckets that counted something are written.
+    FILE* file = fopen(path, "w");
+    if(!file)
+    {
+        printf("Could not write timings to '%s'!\n", path);
+        return false;
+    }
+
+    size_t length = strlen(path);
+    bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+
+    if(json)
+    {
+        fprintf(file, "{\"phases\": [");
+    }
+    else
+    {
+        fprintf(file, "phase,from_ns,to_ns,count\n");
+    }
+
+    for(int p = 0; p < PHASE_COUNT; p++)
+    {
+        const Histogram &h = timing.phases[p];
+        if(json)
+        {
+            fprintf(file, "%s\n  {\"name\": \"%s\", \"count\": %llu, \"total_ns\": %llu, \"p50_ns\": %llu, "
+                "\"p99_ns\": %llu, \"max_ns\": %llu, \"buckets\": [", p ? "," : "", PHASE_NAMES[p],
+                (unsigned long long) h.count, (unsigned long long) h.total, (unsigned long long) percentile(h, 0.5),
+                (unsigned long long) percentile(h, 0.99), (unsigned long long) h.worst);
+        }
+
+        bool first = true;
+        for(int b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            if(h.counts[b] == 0) continue;
+
+            unsigned long long from = bucketStart(b), to = b + 1 < HISTOGRAM_BUCKETS ? bucketStart(b + 1) : UINT64_MAX;
+            if(json)
+            {
+                fprintf(file, "%s[%llu, %llu, %llu]", first ? "" : ", ", from, to, (unsigned long long) h.counts[b]);
+            }
+            else
+            {
+                fprintf(file, "%s,%llu,%llu,%llu\n", PHASE_NAMES[p], from, to, (unsigned long long) h.counts[b]);
+            }
+            first = false;
+        }
+
+        if(json) fprintf(file, "]}");
+    }
+
+    if(json) fprintf(file, "\n]}\n");
+
+    fclose(file);
+    return true;
+}
+
+uint64_t frameChecksum()
+{
+    // FNV-1a over the offscreen surface's pixels, a row
+    // at a time, leaving out any padding after each row.
+    uint64_t hash = FNV_OFFSET;
+    for(int y = 0; y < offscreen->h; y++)
+    {
+        const Uint8* row = (const Uint8*) offscreen->pixels + y * offscreen->pitch;
+        hash = fnvBytes(hash, row, offscreen->w * 4);
+    }
+
+    return hash;
+}
@@ -0,0 +1,123 @@
+/*
+ * Engine (the window, grid drawing and timing the games share)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "hash.h"
+
+#include <SDL.h>
+
+#include <cstdint>
+#include <vector>
+
+// Parts of a frame that are timed.
+enum Phase
+{
+    PHASE_EVENTS,   // Polling for events.
+    PHASE_UPDATE,   // Changing the game state.
+    PHASE_RENDER,   // Submitting drawing to the renderer.
+    PHASE_PRESENT,  // Showing the frame, including any wait for vsync.
+    PHASE_COUNT
+};
+
+const char* const PHASE_NAMES[PHASE_COUNT] = {"events", "update", "render", "present"};
+
+// Latencies are counted in nanoseconds, in buckets four to a power of
+// two, so a bucket is never wider than a quarter of where it starts.
+const int HISTOGRAM_BUCKETS = 256;
+
+struct Histogram
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count, total, worst;
+};
+
+struct Timing
+{
+    Histogram phases[PHASE_COUNT];
+    double nsPerCount;
+
+    // Whether the histograms are drawn over the game.
+    bool overlay;
+};
+
+// The directions arrowDirection gives the arrow keys. Each game
+// checks that its own directions are numbered the same way.
+const int ARROW_LEFT = 0;
+const int ARROW_UP = 1;
+const int ARROW_RIGHT = 2;
+const int ARROW_DOWN = 3;
+
+// Cells of one colour, gathered by a game as it walks its grid and
+// drawn with one call. The rects are kept between frames to avoid
+// allocating.
+struct CellBatch
+{
+    std::vector<SDL_Rect> rects;
+    Uint8 r, g, b;
+};
+
+// Function prototypes.
+void readWindowArgs(int, char*[]);
+bool initWindow(const char*);
+bool initOffscreen();
+void closeWindow();
+void layoutGrid(int, int, int);
+int arrowDirection(int);
+SDL_Rect gridCell(float, float);
+void drawBatch(CellBatch&);
+int fillRect(const SDL_Rect*);
+int fillRects(const SDL_Rect*, int);
+int copyTexture(SDL_Texture*, const SDL_Rect*, const SDL_Rect*);
+int clearTarget();
+int drawLine(int, int, int, int);
+uint64_t frameChecksum();
+Uint64 startTiming();
+void endTiming(int, Uint64);
+int bucketOf(uint64_t);
+uint64_t bucketStart(int);
+uint64_t percentile(const Histogram&, double);
+int pollEvent(SDL_Event*);
+void present();
+void drawOverlay();
+void printTiming();
+bool dumpTiming(const char*);
+
+extern SDL_Window* window;
+extern SDL_Renderer* renderer;
+
+// What benchmarks draw into, in place of a window.
+extern SDL_Surface* offscreen;
+
+extern bool fullscreen;
+
+extern int W_WIDTH;
+extern int W_HEIGHT;
+
+// Where the grid is drawn: the pixels per cell, and the offset of the
+// top left cell, which is negative along axes the grid overflows.
+extern int cellSize, xp, yp;
+
+// How many drawing calls have been made to the renderer.
+extern long long drawCalls;
+
+// How long each part of a frame takes.
+extern Timing timing;
+
+#endif
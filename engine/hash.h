@@ -0,0 +1,58 @@
+/*
+ * Engine (hashing and random numbers, shared with the game cores)
+ * Copyright (C) 2020 Czespo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+// Unlike engine.h, this needs no SDL, so the game cores can use it.
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a. Hashes start at FNV_OFFSET, and take in a value at a
+// time with fnvMix, or a run of bytes with fnvBytes.
+const uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+const uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+inline uint64_t fnvMix(uint64_t hash, uint64_t value)
+{
+    return (hash ^ value) * FNV_PRIME;
+}
+
+inline uint64_t fnvBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*) data;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash = fnvMix(hash, bytes[i]);
+    }
+
+    return hash;
+}
+
+// The splitmix64 generator. Each call moves state on and returns the
+// next random number from it.
+inline uint64_t splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+#endif